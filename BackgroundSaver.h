@@ -0,0 +1,140 @@
+#ifndef BACKGROUND_SAVER_H
+#define BACKGROUND_SAVER_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+// ========================= BACKGROUND SAVER =========================
+// Runs save jobs on a worker thread of its own, so the thread that asked
+// (a user logging out, a server session) does not wait for the disk. One
+// job at a time: a request made while a job is still running is coalesced
+// into it (see coalesce(); the caller's changes are already in the
+// journal, so the running job plus the journal cover them). The worker is
+// started on the first job.
+
+class BackgroundSaver {
+    function<bool()> job;
+    bool running;
+    bool stopping;
+    bool lastOk;            // result of the last finished job
+    size_t completed;
+    size_t coalesced;
+    mutable mutex lock;
+    condition_variable wake;
+    condition_variable idle;
+    thread worker;
+
+    BackgroundSaver(const BackgroundSaver&);
+    BackgroundSaver& operator=(const BackgroundSaver&);
+
+    void run() {
+        unique_lock<mutex> g(lock);
+        while (true) {
+            wake.wait(g, [this] { return stopping || running; });
+            if (!running) break;
+            g.unlock();
+            bool ok = job();
+            g.lock();
+            job = function<bool()>();
+            lastOk = ok;
+            ++completed;
+            running = false;
+            idle.notify_all();
+        }
+    }
+
+public:
+    BackgroundSaver()
+            : running(false), stopping(false), lastOk(true), completed(0), coalesced(0) {}
+
+    // Lets a running job finish first
+    ~BackgroundSaver() {
+        {
+            lock_guard<mutex> g(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    // Starts fn on the worker; false (counted as coalesced) if a job is
+    // still running.
+    bool trySubmit(function<bool()> fn) {
+        lock_guard<mutex> g(lock);
+        if (running) {
+            ++coalesced;
+            return false;
+        }
+        job = fn;
+        running = true;
+        if (!worker.joinable()) worker = thread(&BackgroundSaver::run, this);
+        wake.notify_one();
+        return true;
+    }
+
+    // True (and counted as coalesced) if a job is running, which the
+    // caller's request can then ride on.
+    bool coalesce() {
+        lock_guard<mutex> g(lock);
+        if (running) ++coalesced;
+        return running;
+    }
+
+    // Waits for the running job, if any; then the result of the last one
+    bool wait() {
+        unique_lock<mutex> g(lock);
+        idle.wait(g, [this] { return !running; });
+        return lastOk;
+    }
+
+    size_t completedJobs() const {
+        lock_guard<mutex> g(lock);
+        return completed;
+    }
+
+    size_t coalescedRequests() const {
+        lock_guard<mutex> g(lock);
+        return coalesced;
+    }
+};
+
+// ---------- durable file replacement ----------
+// fsync on the directory holding path, so renames and new names in it
+// survive a crash.
+inline void syncDirectoryOf(const string &path) {
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+}
+
+// Writes data to path + ".tmp", fsyncs it and renames it over path, so
+// path always holds either the old or the new contents in full.
+inline bool replaceFileAtomically(const string &path, const string &data) {
+    string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) return false;
+    bool ok = data.empty() || fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fflush(f) == 0) && ok;
+    if (ok) ok = ::fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+    syncDirectoryOf(path);
+    return true;
+}
+
+#endif // BACKGROUND_SAVER_H
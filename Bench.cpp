@@ -0,0 +1,1770 @@
+// Benchmarks for the library data structures.
+// Build: g++ -std=c++17 -O2 -pthread Bench.cpp -o Bench
+// Usage: ./Bench [name]   (no name = run everything except suite, server, pipeline)
+//        ./Bench suite [maxBooks]   JSON lines, one per measurement
+//        ./Bench server [maxSessions]   load generator for the socket server
+//        ./Bench pipeline [maxThreads]  striped locks vs single-writer pipeline
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <malloc.h>
+#include "Library.h"
+#include "User.h"
+#include "Server.h"
+#include "Pipeline.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Every operator new in the program comes through here, so a benchmark can
+// count the heap allocations a code path makes.
+atomic<size_t> heapAllocations(0);
+
+__attribute__((noinline)) void* operator new(size_t n) {
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(n == 0 ? 1 : n);
+    if (p == NULL) throw bad_alloc();
+    return p;
+}
+
+// none of these is inlined, so the compiler does not see malloc / free
+// under new / delete and warn about the pairing
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { free(p); }
+
+inline double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Simple deterministic generator so every run sees the same ids
+struct Rng {
+    unsigned long long s;
+    explicit Rng(unsigned long long seed) : s(seed) {}
+    unsigned long long next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    int below(int n) { return (int)(next() % (unsigned long long)n); }
+};
+
+// Fills lib with ids 1..n through the bulk loader path.
+inline void fillCatalog(Library &lib, int n) {
+    vector<BookNode*> nodes;
+    nodes.reserve(n);
+    for (int id = 1; id <= n; ++id) {
+        nodes.push_back(lib.newBook(id, "Title " + to_string(id),
+                                    "Author " + to_string(id % 997), 3, 3));
+    }
+    lib.bulkInsert(nodes);
+}
+
+// The pre-index findById: walk the list from the head.
+inline BookNode* findByWalk(const Library &lib, int id) {
+    BookNode *cur = lib.firstBook();
+    while (cur != NULL) {
+        if (cur->id == id) return cur;
+        cur = cur->next;
+    }
+    return NULL;
+}
+
+// Same books, fields and order in both catalogs
+inline bool sameCatalog(const Library &a, const Library &b) {
+    const BookNode *x = a.firstBook(), *y = b.firstBook();
+    for (; x != NULL && y != NULL; x = x->next, y = y->next) {
+        if (x->id != y->id || x->title != y->title || x->author != y->author ||
+            x->totalCopies != y->totalCopies || x->availableCopies != y->availableCopies) {
+            return false;
+        }
+    }
+    return x == NULL && y == NULL;
+}
+
+// ---------- findById: list walk vs hash index ----------
+void benchIdIndex() {
+    int sizes[] = {10000, 100000, 1000000};
+    cout << "== findById: list walk vs hash index ==\n";
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        fillCatalog(lib, n);
+
+        // Keep the walk to a fixed budget of visited nodes so 1M stays quick
+        int walkQueries = (int)(200000000LL / n);
+        if (walkQueries > 20000) walkQueries = 20000;
+        int hashQueries = 2000000;
+
+        Rng rng(42);
+        long long sink = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int i = 0; i < walkQueries; ++i) {
+            sink += findByWalk(lib, 1 + rng.below(n))->totalCopies;
+        }
+        double walkNs = secondsSince(t0) * 1e9 / walkQueries;
+
+        rng = Rng(42);
+        t0 = Clock::now();
+        for (int i = 0; i < hashQueries; ++i) {
+            sink += lib.findById(1 + rng.below(n))->totalCopies;
+        }
+        double hashNs = secondsSince(t0) * 1e9 / hashQueries;
+
+        printf("n=%-8d walk=%12.1f ns/op  hash=%8.1f ns/op  speedup=%.0fx  (%lld)\n",
+               n, walkNs, hashNs, walkNs / hashNs, sink % 10);
+    }
+}
+
+// ---------- startup: bulk loader vs per-line insertSorted ----------
+inline void writeCatalogFile(const string &path, int n) {
+    FILE *f = fopen(path.c_str(), "w");
+    for (int id = 1; id <= n; ++id) {
+        fprintf(f, "%d|Title %d|Author %d|3|3\n", id, id, id % 997);
+    }
+    fclose(f);
+}
+
+inline void removeLibraryFiles(const string &path) {
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+    remove((path + ".journal.prev").c_str());
+    remove((path + ".snap").c_str());
+}
+
+// The original loader: stringstream parsing and one insertSorted per line.
+inline void legacyLoad(Library &lib, const string &path) {
+    ifstream fin(path.c_str());
+    string line;
+    while (getline(fin, line)) {
+        if (line.empty()) continue;
+        stringstream ss(line);
+        string part, title, author;
+        getline(ss, part, '|');
+        int id = atoi(part.c_str());
+        getline(ss, title, '|');
+        getline(ss, author, '|');
+        getline(ss, part, '|');
+        int total = atoi(part.c_str());
+        getline(ss, part, '|');
+        int avail = atoi(part.c_str());
+        lib.insertSorted(lib.newBook(id, title, author, total, avail));
+    }
+}
+
+void benchLoad() {
+    const string path = "bench_books.txt";
+    cout << "== loadFromFile: bulk loader vs per-line insertSorted ==\n";
+    int legacySizes[] = {5000, 10000, 20000};
+    for (int s = 0; s < 3; ++s) {
+        int n = legacySizes[s];
+        writeCatalogFile(path, n);
+        Library lib(path);
+        Clock::time_point t0 = Clock::now();
+        legacyLoad(lib, path);
+        double sec = secondsSince(t0);
+        printf("legacy n=%-8d %9.3f s  %8.1f ns/book\n", n, sec, sec * 1e9 / n);
+    }
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        writeCatalogFile(path, n);
+        Library lib(path);
+        Clock::time_point t0 = Clock::now();
+        lib.loadFromFile();
+        double sec = secondsSince(t0);
+        printf("bulk   n=%-8d %9.3f s  %8.1f ns/book\n", n, sec, sec * 1e9 / n);
+    }
+
+    // parallel parse: same catalog for every thread count
+    int n = 2000000;
+    writeCatalogFile(path, n);
+    Library reference(path);
+    reference.setLoadThreads(1);
+    reference.loadFromFile();
+    unsigned threadCounts[] = {1, 2, 4, 8};
+    for (int t = 0; t < 4; ++t) {
+        Library lib(path);
+        lib.setLoadThreads(threadCounts[t]);
+        Clock::time_point t0 = Clock::now();
+        lib.loadFromFile();
+        double sec = secondsSince(t0);
+        printf("parse  n=%-8d threads=%u %7.3f s  %8.1f ns/book  same=%s\n", n,
+               threadCounts[t], sec, sec * 1e9 / n,
+               sameCatalog(reference, lib) ? "yes" : "NO");
+    }
+    remove(path.c_str());
+}
+
+// ---------- startup: text catalog vs mapped binary snapshot ----------
+void benchSnapshot() {
+    const string path = "bench_books.txt";
+    cout << "== startup: books.txt vs binary snapshot ==\n";
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        writeCatalogFile(path, n);
+        remove((path + ".snap").c_str());
+        remove((path + ".journal").c_str());
+        double textSec, snapSec;
+        {
+            Library lib(path);
+            Clock::time_point t0 = Clock::now();
+            lib.loadFromFile();
+            textSec = secondsSince(t0);
+            lib.writeSnapshot();
+        }
+        {
+            Library lib(path);
+            Clock::time_point t0 = Clock::now();
+            lib.loadFromFile();
+            snapSec = secondsSince(t0);
+        }
+        SnapshotView view;
+        Clock::time_point t0 = Clock::now();
+        view.open(path + ".snap");
+        long long sum = 0;
+        for (size_t i = 0; i < view.bookCount(); ++i) {
+            sum += view.book(i).availableCopies + (long long)view.str(view.book(i).title).size();
+        }
+        double scanSec = secondsSince(t0);
+        printf("n=%-8d text load=%8.3f s  snapshot load=%8.3f s  mapped scan=%8.4f s (%lld)\n",
+               n, textSec, snapSec, scanSec, sum % 10);
+    }
+    remove(path.c_str());
+    remove((path + ".snap").c_str());
+    remove((path + ".journal").c_str());
+}
+
+// ---------- searchByTitle / searchByAuthor: n-gram index vs full scan ----------
+inline vector<BookNode*> scanTitle(const Library &lib, const string &q) {
+    vector<BookNode*> out;
+    for (BookNode *cur = lib.firstBook(); cur != NULL; cur = cur->next) {
+        if (cur->title.view().find(q) != string_view::npos) out.push_back(cur);
+    }
+    return out;
+}
+
+void benchSearch() {
+    const char *words[] = {"River", "Night", "Garden", "Stone", "Winter",
+                           "Shadow", "Empire", "Silent", "Glass", "Harbor"};
+    int sizes[] = {10000, 100000, 1000000};
+    const char *queries[] = {"Title 123456", "Garden of", "Shadow Stone 77", "zzz", "Q", "of"};
+    cout << "== searchByTitle: substring index vs full scan ==\n";
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        Rng rng(7);
+        vector<BookNode*> nodes;
+        for (int id = 1; id <= n; ++id) {
+            string t = string(words[rng.below(10)]) + " of the " + words[rng.below(10)] +
+                       " " + words[rng.below(10)] + " " + to_string(id % 1000);
+            if (id % 50000 == 0) t += " Title " + to_string(id);
+            nodes.push_back(lib.newBook(id, t, "Author " + to_string(id % 997), 1, 1));
+        }
+        lib.bulkInsert(nodes);
+        Clock::time_point tb = Clock::now();
+        lib.findByTitle("warm");
+        double build = secondsSince(tb);
+        size_t bytes = lib.searchIndexMemory().substring;
+        printf("n=%-8d index build: %.3f s  memory: %.1f MB (%.0f B/book, title + author)\n",
+               n, build, bytes / 1048576.0, (double)bytes / n);
+        for (int q = 0; q < 6; ++q) {
+            string query = queries[q];
+            int reps = 20;
+            Clock::time_point t0 = Clock::now();
+            vector<BookNode*> a;
+            for (int r = 0; r < reps; ++r) a = scanTitle(lib, query);
+            double scanUs = secondsSince(t0) * 1e6 / reps;
+            t0 = Clock::now();
+            vector<BookNode*> b;
+            for (int r = 0; r < reps; ++r) b = lib.findByTitle(query);
+            double idxUs = secondsSince(t0) * 1e6 / reps;
+            printf("n=%-8d q=%-16s hits=%-7zu scan=%10.1f us  index=%10.1f us  %s\n",
+                   n, ("\"" + query + "\"").c_str(), b.size(), scanUs, idxUs,
+                   a == b ? "ok" : "MISMATCH");
+        }
+    }
+}
+
+// ---------- typo-tolerant search: trigram index, one typo per query ----------
+inline string syllableWord(Rng &rng) {
+    const char *cons = "bcdfghklmnprstvwz";
+    const char *vow = "aeiou";
+    string w;
+    int syl = 2 + rng.below(2);
+    for (int i = 0; i < syl; ++i) {
+        w += cons[rng.below(17)];
+        w += vow[rng.below(5)];
+    }
+    w[0] = (char)(w[0] - 'a' + 'A');
+    return w;
+}
+
+// One substitution, deletion or swap of neighbours, away from the ends
+inline string withTypo(Rng &rng, string s) {
+    size_t i = 1 + (size_t)rng.below((int)s.size() - 2);
+    int kind = rng.below(3);
+    if (kind == 0) s[i] = (char)('a' + rng.below(26));
+    else if (kind == 1) s.erase(i, 1);
+    else swap(s[i], s[i + 1]);
+    return s;
+}
+
+void benchFuzzy() {
+    cout << "== typo-tolerant title / author search (top 10) ==\n";
+    vector<string> vocab;
+    Rng vr(11);
+    for (int i = 0; i < 20000; ++i) vocab.push_back(syllableWord(vr));
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        Rng rng(5);
+        vector<BookNode*> nodes;
+        for (int id = 1; id <= n; ++id) {
+            string t = vocab[rng.below(20000)] + " " + vocab[rng.below(20000)] + " " +
+                       vocab[rng.below(20000)];
+            string a = vocab[rng.below(2000)] + " " + vocab[rng.below(20000)];
+            nodes.push_back(lib.newBook(id, t, a, 1, 1));
+        }
+        lib.bulkInsert(nodes);
+        Clock::time_point t0 = Clock::now();
+        lib.fuzzyFindTitle("warm", 10);
+        double build = secondsSince(t0);
+
+        // the console's way: the build starts after load, off the caller's thread
+        Library bg("bench_books.txt");
+        vector<BookNode*> copies;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            copies.push_back(bg.newBook(nodes[i]->id, nodes[i]->title, nodes[i]->author, 1, 1));
+        }
+        bg.bulkInsert(copies);
+        t0 = Clock::now();
+        bg.prepareSearchInBackground();
+        double start = secondsSince(t0);
+        bg.deleteBook(1);               // while the build runs
+        bool agree = true;
+        for (int q = 0; q < 20; ++q) {
+            string query = nodes[q]->title.str();
+            vector<FuzzyMatch> want = lib.fuzzyFindTitle(query, 11);   // book 1 may be in it
+            vector<FuzzyMatch> got = bg.fuzzyFindTitle(query, 10);
+            size_t w = 0;
+            for (size_t i = 0; i < got.size(); ++i, ++w) {
+                if (w < want.size() && want[w].book->id == 1) ++w;
+                if (w >= want.size() || got[i].book->id != want[w].book->id) agree = false;
+            }
+        }
+
+        const int queries = 200;
+        int found[2] = {0, 0};
+        double total[2] = {0, 0}, worst[2] = {0, 0};
+        for (int q = 0; q < queries; ++q) {
+            BookNode *b = lib.findById(1 + rng.below(n));
+            for (int f = 0; f < 2; ++f) {
+                string query = withTypo(rng, (f == 0 ? b->title : b->author).str());
+                t0 = Clock::now();
+                vector<FuzzyMatch> hits = f == 0 ? lib.fuzzyFindTitle(query, 10)
+                                                 : lib.fuzzyFindAuthor(query, 10);
+                double sec = secondsSince(t0);
+                total[f] += sec;
+                if (sec > worst[f]) worst[f] = sec;
+                for (size_t i = 0; i < hits.size(); ++i) {
+                    // an author is shared by many books: any with that name counts
+                    if (hits[i].book == b || (f == 1 && hits[i].book->author == b->author)) {
+                        ++found[f];
+                        break;
+                    }
+                }
+            }
+        }
+        printf("n=%-8d build=%6.2f s (background start: %.1f ms, %s)\n", n, build,
+               start * 1e3, agree ? "same results" : "MISMATCH");
+        printf("           title: avg=%7.2f ms max=%7.2f ms hit@10=%3d%%  "
+               "author: avg=%7.2f ms max=%7.2f ms hit@10=%3d%%\n",
+               total[0] * 1e3 / queries, worst[0] * 1e3, found[0] * 100 / queries,
+               total[1] * 1e3 / queries, worst[1] * 1e3, found[1] * 100 / queries);
+    }
+}
+
+// ---------- autocomplete: compressed trie vs scan for the prefix ----------
+inline size_t scanPrefix(const Library &lib, const string &prefix, size_t n) {
+    size_t found = 0;
+    for (BookNode *cur = lib.firstBook(); cur != NULL && found < n; cur = cur->next) {
+        if (cur->title.size() >= prefix.size() &&
+            strncasecmp(cur->title.data(), prefix.c_str(), prefix.size()) == 0) {
+            ++found;
+        }
+    }
+    return found;
+}
+
+void benchPrefix() {
+    cout << "== autocomplete: prefix trie vs list scan (10 completions) ==\n";
+    vector<string> vocab;
+    Rng vr(11);
+    for (int i = 0; i < 20000; ++i) vocab.push_back(syllableWord(vr));
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        Rng rng(5);
+        vector<BookNode*> nodes;
+        for (int id = 1; id <= n; ++id) {
+            string t = vocab[rng.below(20000)] + " " + vocab[rng.below(20000)] + " " +
+                       vocab[rng.below(20000)];
+            nodes.push_back(lib.newBook(id, t, vocab[rng.below(2000)] + " " +
+                                        vocab[rng.below(20000)], 1, 1));
+        }
+        lib.bulkInsert(nodes);
+        Clock::time_point t0 = Clock::now();
+        lib.completeTitle("", 1);
+        double build = secondsSince(t0);
+
+        const int queries = 2000;
+        size_t sink = 0;
+        double trie = 0, scan = 0;
+        for (int q = 0; q < queries; ++q) {
+            string t = lib.findById(1 + rng.below(n))->title.str();
+            string prefix = t.substr(0, 1 + rng.below(6));
+            t0 = Clock::now();
+            sink += lib.completeTitle(prefix, 10).size();
+            trie += secondsSince(t0);
+            if (q < 50) {
+                t0 = Clock::now();
+                sink += scanPrefix(lib, prefix, 10);
+                scan += secondsSince(t0);
+            }
+        }
+
+        // incremental upkeep, on a trie of the same titles
+        PrefixIndex titles;
+        for (BookNode *b = lib.firstBook(); b != NULL; b = b->next) titles.add(b->id, b->title);
+        t0 = Clock::now();
+        for (int i = 1; i <= 2000; ++i) titles.add(n + i, vocab[i] + " Extra " + vocab[i + 1]);
+        for (int i = 1; i <= 2000; ++i) titles.remove(n + i, vocab[i] + " Extra " + vocab[i + 1]);
+        double upkeep = secondsSince(t0) * 1e6 / 4000;
+
+        SearchIndexMemory m = lib.searchIndexMemory();
+        printf("n=%-8d build=%6.2f s  trie=%7.2f us/query  scan=%9.1f us/query  "
+               "add/remove=%6.2f us  memory=%7.1f MB (%zu keys, %zu nodes)  (%zu)\n",
+               n, build, trie * 1e6 / queries, scan * 1e6 / 50, upkeep,
+               m.prefix / 1048576.0, m.prefixKeys, m.prefixNodes, sink % 10);
+    }
+    removeLibraryFiles("bench_books.txt");
+}
+
+// ---------- ordered id index: insert / delete / range vs list walks ----------
+// The pre-B+tree insertSorted / removeBook: walk to the predecessor.
+inline BookNode* predecessorByWalk(const Library &lib, int id) {
+    BookNode *prev = NULL;
+    for (BookNode *cur = lib.firstBook(); cur != NULL && cur->id < id; cur = cur->next) {
+        prev = cur;
+    }
+    return prev;
+}
+
+void benchOrder() {
+    cout << "== ordered id index: add / delete / id range ==\n";
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        // even ids 2..2n, so odd ids can be added anywhere in the list
+        vector<BookNode*> nodes;
+        for (int id = 1; id <= n; ++id) {
+            nodes.push_back(lib.newBook(2 * id, "Title", "Author", 1, 1));
+        }
+        Clock::time_point t0 = Clock::now();
+        lib.bulkInsert(nodes);
+        double bulk = secondsSince(t0);
+
+        Rng rng(9);
+        int walks = (int)(100000000LL / n);
+        if (walks > 2000) walks = 2000;
+        long long sink = 0;
+        t0 = Clock::now();
+        for (int i = 0; i < walks; ++i) {
+            BookNode *p = predecessorByWalk(lib, 1 + 2 * rng.below(n));
+            if (p != NULL) sink += p->id;
+        }
+        double walkUs = secondsSince(t0) * 1e6 / walks;
+
+        const int ops = 200000;
+        vector<int> ids;
+        for (int i = 0; i < ops; ++i) ids.push_back(1 + 2 * rng.below(n));
+        t0 = Clock::now();
+        for (int i = 0; i < ops; ++i) lib.insertSorted(lib.newBook(ids[i], "New", "Author", 1, 1));
+        for (int i = 0; i < ops; ++i) lib.removeBook(ids[i]);
+        double treeUs = secondsSince(t0) * 1e6 / (2 * ops);
+
+        const int ranges = 10000;
+        size_t found = 0;
+        t0 = Clock::now();
+        for (int i = 0; i < ranges; ++i) {
+            int lo = 2 * rng.below(n);
+            found += lib.booksInRange(lo, lo + 2000).size();
+        }
+        double rangeUs = secondsSince(t0) * 1e6 / ranges;
+
+        printf("n=%-8d bulk build=%6.3f s  walk to place=%9.1f us  tree add/delete=%5.2f us  "
+               "range of ~1000=%6.1f us  (%lld %zu)\n",
+               n, bulk, walkUs, treeUs, rangeUs, sink % 10, found / ranges);
+    }
+}
+
+// ---------- issue/return churn: pool heap calls in steady state ----------
+inline size_t poolHeapCalls(const Library &lib) {
+    return lib.bookPoolStats().heapCalls + lib.waitPoolStats().heapCalls +
+           lib.issuedPoolStats().heapCalls;
+}
+
+void benchChurn() {
+    const string path = "bench_books.txt";
+    const int books = 1000, rounds = 200000, newStudents = 20000;
+    removeLibraryFiles(path);
+    writeCatalogFile(path, books);
+    Library lib(path);
+    // known students (as AuthSystem would register them), so the load
+    // makes room for their entries
+    for (int i = 0; i < newStudents; ++i) lib.studentRegistry().idOf("student" + to_string(i));
+    lib.loadFromFile();
+
+    cout << "== issue/return churn: heap calls (journal open, one commit per 1000 rounds) ==\n";
+    size_t warmCalls = 0, warmAllocs = 0;
+    Clock::time_point t0 = Clock::now();
+    {
+        const string students[] = {"student_one", "student_two", "student_three",
+                                   "student_four", "student_five"};
+        Date issued(1, 1, 2025), returned(5, 1, 2025);
+        for (int r = 0; r < rounds; ++r) {
+            if (r == 1000) {
+                warmCalls = poolHeapCalls(lib);
+                warmAllocs = heapAllocations.load();
+            }
+            if (r % 1000 == 0) lib.beginBatch();
+            int id = 1 + r % books;
+            // three take the copies, two queue, then each returns in turn
+            for (int k = 0; k < 5; ++k) lib.issue(id, students[k], issued);
+            for (int k = 0; k < 5; ++k) lib.returnBook(id, students[k], returned);
+            if (r % 1000 == 999) lib.endBatch();
+        }
+    }
+    double sec = secondsSince(t0);
+    size_t steadyCalls = poolHeapCalls(lib) - warmCalls;
+    size_t steadyAllocs = heapAllocations.load() - warmAllocs;
+    long long steadyOps = (rounds - 1000) * 10LL;
+    printf("rounds=%d ops=%d  %.1f ns/op  after warm-up: pool heap calls=%zu  "
+           "operator new=%zu (%.4f per op)\n",
+           rounds, rounds * 10, sec * 1e9 / (rounds * 10.0), steadyCalls, steadyAllocs,
+           (double)steadyAllocs / steadyOps);
+    printf("issued pool: creates=%zu destroys=%zu slabs=%zu  wait pool: creates=%zu slabs=%zu\n",
+           lib.issuedPoolStats().creates, lib.issuedPoolStats().destroys,
+           lib.issuedPoolStats().slabs, lib.waitPoolStats().creates,
+           lib.waitPoolStats().slabs);
+
+    // each student's first request (a loan or a queue place): the entry is
+    // already there
+    size_t before = heapAllocations.load();
+    lib.beginBatch();
+    for (int i = 0; i < newStudents; ++i) {
+        lib.issue(1 + i % books, "student" + to_string(i), Date(1, 1, 2025));
+    }
+    lib.endBatch();
+    size_t firstLoans = heapAllocations.load() - before;
+    printf("first request of %d students: operator new=%zu (%.3f per request)\n",
+           newStudents, firstLoans, (double)firstLoans / newStudents);
+    removeLibraryFiles(path);
+}
+
+// ---------- waiting queue: walk vs maintained count + membership set ----------
+void benchQueue() {
+    cout << "== waiting queue: size / membership / position ==\n";
+    int sizes[] = {100, 1000, 10000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        vector<BookNode*> nodes(1, lib.newBook(1, "Textbook", "Author", 1, 1));
+        lib.bulkInsert(nodes);
+        for (int i = 0; i <= n; ++i) {
+            lib.issue(1, "s" + to_string(i), Date(1, 1, 2025));
+        }
+        BookNode *b = lib.findById(1);
+        string last = "s" + to_string(n);
+        StudentId lastId = lib.studentRegistry().idOf(last);
+        int reps = 100000;
+        long long sink = 0;
+
+        Clock::time_point t0 = Clock::now();
+        for (int r = 0; r < reps / 10; ++r) {
+            int c = 0, pos = 0;
+            for (WaitNode *w = b->waitFront; w != NULL; w = w->next) {
+                ++c;
+                if (pos == 0 && w->student == lastId) pos = c;
+            }
+            sink += c + pos;
+        }
+        double walkNs = secondsSince(t0) * 1e9 / (reps / 10);
+
+        t0 = Clock::now();
+        for (int r = 0; r < reps; ++r) {
+            sink += b->waitingCount() + lib.queuePositionOf(b, last);
+        }
+        double fastNs = secondsSince(t0) * 1e9 / reps;
+        printf("queue=%-6d walk=%10.1f ns  count+set=%6.1f ns  (%lld)\n",
+               n, walkNs, fastNs, sink % 10);
+    }
+}
+
+// ---------- save with a compaction due: inline vs background saver ----------
+// What a user logging out waits for when their save is the one that folds
+// the journal into a new snapshot.
+void benchSave() {
+    cout << "== save with a compaction due: inline snapshot vs background saver ==\n";
+    const string path = "bench_save_books.txt";
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        removeLibraryFiles(path);
+        writeCatalogFile(path, n);
+        Library lib(path);
+        lib.loadFromFile();
+
+        // n + 1 journal records make the next save compact. The background
+        // save still freezes the catalog on this thread (O(n)), so its
+        // "save" time is mostly that copy.
+        lib.beginBatch();
+        for (int i = 0; i <= n; ++i) lib.issue(1 + i % n, i < n ? "a" : "b", Date(1, 1, 2025));
+        lib.endBatch();
+        Clock::time_point t0 = Clock::now();
+        lib.writeSnapshot();
+        double inlineMs = secondsSince(t0) * 1e3;
+
+        lib.beginBatch();
+        for (int i = 0; i <= n; ++i) lib.returnBook(1 + i % n, i < n ? "a" : "b", Date(5, 1, 2025));
+        lib.endBatch();
+        t0 = Clock::now();
+        lib.saveToFile();
+        double returnMs = secondsSince(t0) * 1e3;
+        // more logouts while it is being written
+        size_t before = lib.coalescedSaves();
+        for (int i = 0; i < 10; ++i) {
+            lib.issue(1 + i, "c", Date(6, 1, 2025));
+            lib.saveToFile();
+        }
+        size_t coalesced = lib.coalescedSaves() - before;
+        lib.finishSaves();
+        double doneMs = secondsSince(t0) * 1e3;
+        printf("n=%-7d inline: save=%8.1f ms   background: save (freeze + new journal)=%6.1f ms, "
+               "written after %8.1f ms, %zu/10 later saves coalesced\n",
+               n, inlineMs, returnMs, doneMs, coalesced);
+    }
+    removeLibraryFiles(path);
+}
+
+// ---------- overdue report: due-date heap vs walking every loan ----------
+void benchOverdue() {
+    cout << "== overdue report: due index vs full walk ==\n";
+    int sizes[] = {100000, 1000000};
+    for (int s = 0; s < 2; ++s) {
+        int n = sizes[s];
+        Library lib("bench_books.txt");
+        fillCatalog(lib, n);
+        // one loan per book, issue dates spread over a year
+        Rng rng(11);
+        for (int id = 1; id <= n; ++id) {
+            int day = 1 + rng.below(28), month = 1 + rng.below(12);
+            lib.issue(id, "s" + to_string(id % 5000), Date(day, month, 2025));
+        }
+        Date asOf(20, 1, 2025);
+
+        Clock::time_point t0 = Clock::now();
+        size_t walkHits = 0;
+        for (BookNode *b = lib.firstBook(); b != NULL; b = b->next) {
+            for (IssuedRecord *ir = b->issuedHead; ir != NULL; ir = ir->next) {
+                if (daysBetween(ir->dueDate(), asOf) > 0) ++walkHits;
+            }
+        }
+        double walkMs = secondsSince(t0) * 1e3;
+
+        t0 = Clock::now();
+        vector<Library::OverdueLoan> rows = lib.overdueAsOf(asOf);
+        double idxMs = secondsSince(t0) * 1e3;
+        printf("loans=%-8d overdue=%-6zu walk=%8.2f ms  index=%7.3f ms  %s\n",
+               n, rows.size(), walkMs, idxMs, rows.size() == walkHits ? "ok" : "MISMATCH");
+    }
+}
+
+// The original loop-based date helpers, kept to check and time the
+// closed-form versions against.
+inline int legacyDaysFromStart(const Date &d) {
+    static int monthDays[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    long long days = (long long)d.year * 365LL + d.day;
+    for (int m = 1; m < d.month; ++m) {
+        days += monthDays[m-1];
+        if (m == 2 && isLeap(d.year)) days += 1;
+    }
+    int y = d.year - 1;
+    days += y/4 - y/100 + y/400;
+    return (int)days;
+}
+
+inline Date legacyAddDays(const Date &start, int add) {
+    Date d = start;
+    static int monthDays[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    d.day += add;
+    while (true) {
+        int md = monthDays[d.month-1];
+        if (d.month == 2 && isLeap(d.year)) md = 29;
+        if (d.day <= md) break;
+        d.day -= md;
+        d.month++;
+        if (d.month > 12) {
+            d.month = 1;
+            d.year++;
+        }
+    }
+    return d;
+}
+
+// ---------- date arithmetic: month loops vs closed-form day numbers ----------
+void benchDates() {
+    cout << "== date arithmetic: loops vs day numbers ==\n";
+    // every valid date 1600..2400, a spread of offsets including long ones
+    int adds[] = {0, 1, 13, 14, 27, 31, 45, 90, 365, 366, 1000, 40000};
+    size_t checked = 0, wrong = 0;
+    for (int y = 1600; y <= 2400; ++y) {
+        for (int m = 1; m <= 12; ++m) {
+            for (int d = 1; d <= daysInMonth(y, m); ++d) {
+                Date dt(d, m, y);
+                if (daysFromStart(dt) != legacyDaysFromStart(dt)) ++wrong;
+                Date back = dateFromDays(dayNumber(dt));
+                if (back.day != d || back.month != m || back.year != y) ++wrong;
+                for (size_t a = 0; a < sizeof(adds) / sizeof(adds[0]); ++a) {
+                    Date x = addDays(dt, adds[a]), l = legacyAddDays(dt, adds[a]);
+                    if (x.day != l.day || x.month != l.month || x.year != l.year) ++wrong;
+                }
+                ++checked;
+            }
+        }
+    }
+    printf("dates checked=%zu  %s\n", checked, wrong == 0 ? "ok" : "MISMATCH");
+
+    const int N = 2000000;
+    vector<Date> dates;
+    dates.reserve(N);
+    Rng rng(13);
+    for (int i = 0; i < N; ++i) {
+        int y = 1900 + rng.below(200), m = 1 + rng.below(12);
+        dates.push_back(Date(1 + rng.below(daysInMonth(y, m)), m, y));
+    }
+    int offsets[] = {14, 365, 3650};
+    for (int o = 0; o < 3; ++o) {
+        int add = offsets[o];
+        long long sink = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int i = 0; i < N; ++i) {
+            Date x = legacyAddDays(dates[i], add);
+            sink += legacyDaysFromStart(x) - legacyDaysFromStart(dates[i]);
+        }
+        double oldNs = secondsSince(t0) * 1e9 / N;
+        t0 = Clock::now();
+        for (int i = 0; i < N; ++i) {
+            Date x = addDays(dates[i], add);
+            sink += daysBetween(dates[i], x);
+        }
+        double newNs = secondsSince(t0) * 1e9 / N;
+        printf("add=%-5d addDays+daysBetween  loop=%7.1f ns  closed=%5.1f ns  (%lld)\n",
+               add, oldNs, newNs, sink / N);
+    }
+}
+
+// ---------- persistence: journal append vs full snapshot ----------
+void benchJournal() {
+    const string path = "bench_books.txt";
+    cout << "== save cost: journaled mutation vs full catalog rewrite ==\n";
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        writeCatalogFile(path, n);
+        remove((path + ".journal").c_str());
+        Library lib(path);
+        lib.loadFromFile();
+
+        const int ops = 200;
+        Clock::time_point t0 = Clock::now();
+        for (int i = 0; i < ops; ++i) lib.issue(1 + i, "s1", Date(1, 1, 2025));
+        double perOp = secondsSince(t0) * 1e6 / ops;
+
+        t0 = Clock::now();
+        lib.beginBatch();
+        for (int i = 0; i < ops; ++i) lib.returnBook(1 + i, "s1", Date(5, 1, 2025));
+        lib.endBatch();
+        double batched = secondsSince(t0) * 1e6 / ops;
+
+        t0 = Clock::now();
+        lib.writeSnapshot();
+        double snap = secondsSince(t0) * 1e6;
+        printf("n=%-8d commit per op=%9.1f us  group commit=%7.1f us/op  full snapshot=%11.1f us\n",
+               n, perOp, batched, snap);
+    }
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+}
+
+// ---------- catalog listing: per-field cout vs page buffers vs export ----------
+// The pre-pagination row: one cout call per field.
+inline void printBriefByField(const BookNode *b) {
+    cout << "ID: " << b->id
+         << " | Title: " << b->title
+         << " | Author: " << b->author
+         << " | Total: " << b->totalCopies
+         << " | Available: " << b->availableCopies;
+    int wc = b->waitingCount();
+    if (wc > 0) {
+        cout << " | Waiting: " << wc;
+    }
+    cout << "\n";
+}
+
+void benchDisplay() {
+    const string out = "bench_export.txt";
+    cout << "== full catalog listing (stdout sent to /dev/null) ==\n";
+    cout.flush();
+    int devnull = open("/dev/null", O_WRONLY);
+    int saved = dup(1);
+    int sizes[] = {10000, 100000, 1000000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_unused.txt");
+        fillCatalog(lib, n);
+
+        dup2(devnull, 1);
+        Clock::time_point t0 = Clock::now();
+        for (BookNode *b = lib.firstBook(); b != NULL; b = b->next) printBriefByField(b);
+        cout.flush();
+        double byField = secondsSince(t0);
+
+        t0 = Clock::now();
+        vector<BookNode*> rows;
+        string page;
+        int from = 0;
+        BookNode *next;
+        do {
+            next = lib.catalogPage(from, 50, rows);
+            page.clear();
+            for (size_t i = 0; i < rows.size(); ++i) rows[i]->appendBrief(page);
+            cout.write(page.data(), (streamsize)page.size());
+            cout.flush();
+            if (next != NULL) from = next->id;
+        } while (next != NULL);
+        double paged = secondsSince(t0);
+        dup2(saved, 1);
+
+        double exported[2];
+        for (int f = 0; f < 2; ++f) {
+            FILE *fp = fopen(out.c_str(), "w");
+            t0 = Clock::now();
+            lib.exportCatalog(fp, f == 0 ? EXPORT_TSV : EXPORT_JSONL);
+            fclose(fp);
+            exported[f] = secondsSince(t0);
+        }
+        printf("n=%-8d per-field cout=%8.1f ms  50-row pages=%8.1f ms  "
+               "TSV export=%7.1f ms  JSONL export=%7.1f ms\n",
+               n, byField * 1e3, paged * 1e3, exported[0] * 1e3, exported[1] * 1e3);
+        fflush(stdout);
+    }
+    close(saved);
+    close(devnull);
+    remove(out.c_str());
+}
+
+// Swallows everything written to it (used to mute the console output).
+struct NullBuffer : streambuf {
+    int overflow(int c) { return c; }
+    streamsize xsputn(const char *, streamsize n) { return n; }
+};
+
+// Drives an interactive prompt (AuthSystem::login) with scripted input.
+struct ScriptedConsole {
+    streambuf *oldIn, *oldOut;
+    istringstream in;
+    NullBuffer sink;
+    ScriptedConsole() : oldIn(cin.rdbuf()), oldOut(cout.rdbuf()) {
+        cin.rdbuf(in.rdbuf());
+        cout.rdbuf(&sink);
+    }
+    ~ScriptedConsole() {
+        cin.rdbuf(oldIn);
+        cout.rdbuf(oldOut);
+    }
+    void feed(const string &text) {
+        in.clear();
+        in.str(text);
+    }
+};
+
+// ---------- AuthSystem::login: per-call file scan vs in-memory directory ----------
+// The original login: read users.txt into a vector and scan it.
+inline bool legacyLogin(AuthSystem &auth, const string &uname, const string &pass) {
+    vector<User> users;
+    if (!auth.loadAllUsers(users)) return false;
+    for (size_t i = 0; i < users.size(); ++i) {
+        if (users[i].username == uname && users[i].password == pass) return true;
+    }
+    return false;
+}
+
+void benchAuth() {
+    const string path = "bench_users.txt";
+    cout << "== login: file re-read vs in-memory directory ==\n";
+    int sizes[] = {1000, 10000, 100000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        FILE *f = fopen(path.c_str(), "w");
+        for (int i = 0; i < n; ++i) fprintf(f, "u%07d|pw%d|STUDENT\n", i, i);
+        fclose(f);
+        AuthSystem auth(path);
+
+        Rng rng(3);
+        int legacyOps = 20, ok = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int i = 0; i < legacyOps; ++i) {
+            int u = rng.below(n);
+            char name[16];
+            snprintf(name, sizeof(name), "u%07d", u);
+            ok += legacyLogin(auth, name, "pw" + to_string(u));
+        }
+        double legacyUs = secondsSince(t0) * 1e6 / legacyOps;
+
+        int ops = 20000;
+        User user;
+        t0 = Clock::now();
+        {
+            ScriptedConsole console;
+            for (int i = 0; i < ops; ++i) {
+                int u = rng.below(n);
+                char line[48];
+                snprintf(line, sizeof(line), "u%07d\npw%d\n", u, u);
+                console.feed(line);
+                ok += auth.login(user);
+            }
+        }
+        double us = secondsSince(t0) * 1e6 / ops;
+        printf("users=%-7d re-read=%10.1f us/login  directory=%6.2f us/login  (ok=%d)\n",
+               n, legacyUs, us, ok);
+    }
+    remove(path.c_str());
+}
+
+// ---------- metrics: cost of one timed scope, and of a dump ----------
+void benchMetrics() {
+    cout << "== metrics: timed scope vs an issue / return pair ==\n";
+    int ops = 2000000;
+    volatile int sink = 0;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < ops; ++i) {
+        MetricTimer timer(OP_SEARCH);
+        sink = sink + i;
+    }
+    double timedNs = secondsSince(t0) * 1e9 / ops;
+
+    int n = 1000000;
+    Library lib("bench_metrics.txt");
+    fillCatalog(lib, n);
+    Date day = {1, 1, 2026};
+    Rng rng(5);
+    int pairs = 200000;
+    t0 = Clock::now();
+    for (int i = 0; i < pairs; ++i) {
+        int id = 1 + rng.below(n);
+        lib.issue(id, "s1", day);
+        lib.returnBook(id, "s1", day);
+    }
+    double pairNs = secondsSince(t0) * 1e9 / pairs;
+    printf("timed scope=%6.1f ns  issue+return=%7.1f ns  (2 scopes = %.1f%%)\n",
+           timedNs, pairNs, 200.0 * timedNs / pairNs);
+
+    int dumps = 1000;
+    size_t bytes = 0;
+    t0 = Clock::now();
+    for (int i = 0; i < dumps; ++i) {
+        string text;
+        Metrics::global().appendPrometheus(text);
+        lib.appendMetrics(text);
+        bytes = text.size();
+    }
+    printf("books=%d dump=%7.1f us (%zu bytes)\n", n, secondsSince(t0) * 1e6 / dumps, bytes);
+    remove("bench_metrics.txt.journal");
+}
+
+// ---------- title / author storage: std::string vs interned pool ----------
+inline size_t heapInUse() {
+    struct mallinfo2 m = mallinfo2();
+    return m.uordblks + m.hblkhd;       // small blocks + mmapped ones
+}
+
+void benchStrings() {
+    cout << "== title / author storage: own strings vs interned pool ==\n";
+    int n = 1000000;
+    Rng rng(11);
+    vector<string> vocab, authors;
+    for (int i = 0; i < 20000; ++i) vocab.push_back(syllableWord(rng));
+    for (int i = 0; i < 40000; ++i) authors.push_back(syllableWord(rng) + " " + syllableWord(rng));
+
+    // a few prolific authors, a long tail; a quarter of the titles are
+    // other editions of an earlier title
+    vector<pair<string, string> > rows;
+    rows.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        string title;
+        if (i > 0 && rng.below(4) == 0) {
+            title = rows[rng.below(i)].first;
+        } else {
+            int words = 1 + rng.below(5);
+            for (int w = 0; w < words; ++w) {
+                if (w > 0) title += ' ';
+                title += vocab[rng.below(20000)];
+            }
+        }
+        rows.push_back(make_pair(title, authors[rng.below(1 + rng.below(40000))]));
+    }
+
+    size_t h0 = heapInUse();
+    Clock::time_point t0 = Clock::now();
+    vector<pair<string, string> > own(rows.begin(), rows.end());
+    double ownSec = secondsSince(t0);
+    double ownText = (double)(heapInUse() - h0) / n - sizeof(pair<string, string>);
+    own.clear();
+    own.shrink_to_fit();
+
+    StringPool pool;
+    vector<pair<StrRef, StrRef> > refs;
+    refs.reserve(n);
+    t0 = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        refs.push_back(make_pair(pool.intern(rows[i].first), pool.intern(rows[i].second)));
+    }
+    double poolSec = secondsSince(t0);
+    double poolText = (double)pool.memoryBytes() / n;
+
+    size_t nodeNow = sizeof(BookNode);
+    size_t nodeBefore = nodeNow + 2 * (sizeof(string) - sizeof(StrRef));
+    printf("books=%d distinct strings=%zu (%.1f MB of text)\n",
+           n, pool.size(), pool.storedTextBytes() / 1048576.0);
+    printf("std::string  node=%3zu B + text heap=%5.1f B  = %6.1f B/book  build %6.1f ns/book\n",
+           nodeBefore, ownText, nodeBefore + ownText, ownSec * 1e9 / n);
+    printf("StringPool   node=%3zu B + pool     =%5.1f B  = %6.1f B/book  build %6.1f ns/book\n",
+           nodeNow, poolText, nodeNow + poolText, poolSec * 1e9 / n);
+}
+
+// ---------- student handles: name copies vs registry ids ----------
+// Queue places as they were before the registry: the same links, but the
+// student's name copied into every node.
+struct NamedWaitNode {
+    string student;
+    NamedWaitNode *next;
+    long long ticket;
+    BookNode *book;
+    StudentEntry *owner;
+    NamedWaitNode *studentPrev;
+    NamedWaitNode *studentNext;
+};
+
+void benchStudents() {
+    cout << "== student handles: name per queue place vs 32-bit id ==\n";
+    int sizes[] = {1000, 10000, 100000};
+    for (int s = 0; s < 3; ++s) {
+        int n = sizes[s];
+        Library lib("bench_students.txt");
+        vector<BookNode*> nodes(1, lib.newBook(1, "Textbook", "Author", 1, 1));
+        lib.bulkInsert(nodes);
+        vector<string> names;
+        for (int i = 0; i <= n; ++i) {
+            char name[32];
+            snprintf(name, sizeof(name), "student_2025_%06d", i);
+            names.push_back(name);
+        }
+
+        size_t h0 = heapInUse();
+        NamedWaitNode *front = NULL, *back = NULL;
+        for (int i = 1; i <= n; ++i) {
+            NamedWaitNode *w = new NamedWaitNode();
+            w->student = names[i];
+            if (back == NULL) front = w; else back->next = w;
+            back = w;
+        }
+        double namedBytes = (double)(heapInUse() - h0) / n;
+        lib.issue(1, names[0], Date(1, 1, 2025));
+        for (int i = 1; i <= n; ++i) lib.issue(1, names[i], Date(1, 1, 2025));
+        BookNode *b = lib.findById(1);
+
+        // the same places with ids (the registry holds each name once,
+        // whether or not the student is queued anywhere)
+        vector<WaitNode*> plain;
+        plain.reserve(n);
+        h0 = heapInUse();
+        for (int i = 1; i <= n; ++i) plain.push_back(new WaitNode((StudentId)i));
+        double idBytes = (double)(heapInUse() - h0) / n;
+        for (size_t i = 0; i < plain.size(); ++i) delete plain[i];
+
+        // worst case: the last student in the queue
+        const string &last = names[n];
+        StudentId lastId = lib.studentRegistry().idOf(last);
+        int reps = max(20, 2000000 / n);
+        long long sink = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int r = 0; r < reps; ++r) {
+            int c = 0;
+            for (NamedWaitNode *w = front; w != NULL; w = w->next, ++c) {
+                if (w->student == last) { sink += c; break; }
+            }
+        }
+        double nameNs = secondsSince(t0) * 1e9 / reps / n;
+        t0 = Clock::now();
+        for (int r = 0; r < reps; ++r) {
+            int c = 0;
+            for (WaitNode *w = b->waitFront; w != NULL; w = w->next, ++c) {
+                if (w->student == lastId) { sink += c; break; }
+            }
+        }
+        double idNs = secondsSince(t0) * 1e9 / reps / n;
+
+        printf("queue=%-7d node: name=%3zu B id=%3zu B  heap/place: name=%5.1f B id=%5.1f B  "
+               "compare: name=%5.2f ns id=%5.2f ns  (%lld)\n",
+               n, sizeof(NamedWaitNode), sizeof(WaitNode), namedBytes, idBytes,
+               nameNs, idNs, sink % 10);
+        while (front != NULL) {
+            NamedWaitNode *next = front->next;
+            delete front;
+            front = next;
+        }
+    }
+    remove("bench_students.txt.journal");
+}
+
+// ---------- teardown: bulk slab release ----------
+void benchTeardown() {
+    cout << "== ~Library teardown ==\n";
+    int sizes[] = {100000, 1000000};
+    for (int s = 0; s < 2; ++s) {
+        Library *lib = new Library("bench_books.txt");
+        fillCatalog(*lib, sizes[s]);
+        Clock::time_point t0 = Clock::now();
+        delete lib;
+        printf("n=%-8d %8.3f s\n", sizes[s], secondsSince(t0));
+    }
+}
+
+// ---------- mutations: per-book locking vs single-writer pipeline ----------
+// Each producer thread issues a random book to its own student and returns
+// it again. "locked" uses the server's scheme (shared catalog lock, stripe
+// per book, Library::StateGuard, group-committed journal); "pipeline" hands
+// the same calls to CommandPipeline, keeping up to 64 in flight per thread.
+void lockedProducer(Library *lib, shared_mutex *cat, mutex *stripes, int seed,
+                    int ops, int books) {
+    Rng rng(seed);
+    string student = "p" + to_string(seed);
+    for (int i = 0; i < ops; i += 2) {
+        int id = 1 + rng.below(books);
+        shared_lock<shared_mutex> g(*cat);
+        lock_guard<mutex> b(stripes[(unsigned)id % 256]);
+        lib->issue(id, student, Date(1, 1, 2025));
+        lib->returnBook(id, student, Date(5, 1, 2025));
+    }
+}
+
+void pipelineProducer(CommandPipeline *pipe, int seed, int ops, int books) {
+    Rng rng(seed);
+    string student = "p" + to_string(seed);
+    vector<future<IssueResult> > issued;
+    vector<future<ReturnResult> > returned;
+    for (int i = 0; i < ops; i += 128) {
+        for (int k = 0; k < 64 && i + 2 * k < ops; ++k) {
+            int id = 1 + rng.below(books);
+            issued.push_back(pipe->issue(id, student, Date(1, 1, 2025)));
+            returned.push_back(pipe->returnBook(id, student, Date(5, 1, 2025)));
+        }
+        for (size_t k = 0; k < issued.size(); ++k) {
+            issued[k].get();
+            returned[k].get();
+        }
+        issued.clear();
+        returned.clear();
+    }
+}
+
+// Producers flood one single-copy book; each one's students must come out
+// of the waiting queue in the order that producer submitted them, at the
+// positions the futures reported.
+bool pipelineKeepsFifo(Library &lib, int producers, int perProducer) {
+    lib.addBook(999999, "Contended", "Author", 1);
+    vector<vector<future<IssueResult> > > results(producers);
+    {
+        CommandPipeline pipe(lib, 32);
+        vector<thread> threads;
+        for (int t = 0; t < producers; ++t) {
+            threads.push_back(thread([&pipe, &results, t, perProducer]() {
+                for (int k = 0; k < perProducer; ++k) {
+                    results[t].push_back(pipe.issue(999999, "f" + to_string(t) + "_" +
+                                                    to_string(k), Date(1, 1, 2025)));
+                }
+            }));
+        }
+        for (int t = 0; t < producers; ++t) threads[t].join();
+    }
+    BookNode *b = lib.findById(999999);
+    vector<int> lastSeen(producers, -1);
+    int pos = 0;
+    bool ok = true;
+    for (WaitNode *w = b->waitFront; w != NULL; w = w->next) {
+        ++pos;
+        const string &name = lib.studentName(w->student);
+        int t = atoi(name.c_str() + 1);
+        int k = atoi(name.c_str() + name.find('_') + 1);
+        if (k <= lastSeen[t]) ok = false;
+        lastSeen[t] = k;
+        IssueResult r = results[t][k].get();
+        if (r.status != LIB_QUEUED || r.queuePosition != pos) ok = false;
+    }
+    return ok && pos == producers * perProducer - 1;
+}
+
+void benchPipeline(int maxThreads) {
+    const string path = "bench_pipe_books.txt";
+    const int books = 100000, opsPerThread = 20000;
+    cout << "== mutations: striped locks vs single-writer pipeline ==\n";
+    for (int mode = 0; mode < 2; ++mode) {
+        for (int t = 1; t <= maxThreads; t *= 2) {
+            removeLibraryFiles(path);
+            writeCatalogFile(path, books);
+            Library lib(path);
+            lib.loadFromFile();
+            vector<thread> threads;
+            Clock::time_point t0 = Clock::now();
+            long long batches = 0;
+            if (mode == 0) {
+                shared_mutex cat;
+                vector<mutex> stripes(256);
+                lib.setConcurrent(true);
+                for (int i = 0; i < t; ++i) {
+                    threads.push_back(thread(lockedProducer, &lib, &cat, &stripes[0],
+                                             i + 1, opsPerThread, books));
+                }
+                for (int i = 0; i < t; ++i) threads[i].join();
+                lib.setConcurrent(false);
+            } else {
+                CommandPipeline pipe(lib);
+                for (int i = 0; i < t; ++i) {
+                    threads.push_back(thread(pipelineProducer, &pipe, i + 1,
+                                             opsPerThread, books));
+                }
+                for (int i = 0; i < t; ++i) threads[i].join();
+                batches = pipe.batchCount();
+            }
+            double sec = secondsSince(t0);
+            long long ops = (long long)t * opsPerThread;
+            printf("%-8s threads=%-3d %9.0f ops/s", mode == 0 ? "locked" : "pipeline",
+                   t, ops / sec);
+            if (mode == 1) printf("  batches=%lld (%.0f ops/commit)", batches, (double)ops / batches);
+            printf("\n");
+        }
+    }
+    Library lib("bench_pipe_fifo.txt");
+    printf("pipeline FIFO under contention (8 producers x 2000): %s\n",
+           pipelineKeepsFifo(lib, 8, 2000) ? "ok" : "VIOLATED");
+    removeLibraryFiles(path);
+}
+
+// ---------- synthetic suite: throughput, p50/p99 and peak RSS per size ----------
+// Every size runs in its own child process so peak RSS belongs to that size.
+// Mutations run inside journal batches, so the numbers measure the data
+// structures rather than fsync latency.
+inline long peakRssKb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+// Per-operation latencies of one measurement
+struct Latencies {
+    vector<double> ns;
+    Clock::time_point opStart;
+
+    void start() { opStart = Clock::now(); }
+    void stop() {
+        ns.push_back(chrono::duration<double, nano>(Clock::now() - opStart).count());
+    }
+
+    double percentile(double p) {
+        if (ns.empty()) return 0;
+        size_t k = (size_t)(p * (ns.size() - 1));
+        nth_element(ns.begin(), ns.begin() + k, ns.end());
+        return ns[k];
+    }
+
+    void report(const char *bench, int books) {
+        double sec = 0;
+        for (size_t i = 0; i < ns.size(); ++i) sec += ns[i] * 1e-9;
+        double p50 = percentile(0.50), p99 = percentile(0.99);
+        printf("{\"bench\":\"%s\",\"books\":%d,\"ops\":%zu,\"seconds\":%.6f,"
+               "\"ops_per_sec\":%.1f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"peak_rss_kb\":%ld}\n",
+               bench, books, ns.size(), sec, sec > 0 ? ns.size() / sec : 0.0,
+               p50, p99, peakRssKb());
+        fflush(stdout);
+    }
+};
+
+const char *suiteWords[] = {"River", "Night", "Garden", "Stone", "Winter", "Shadow",
+                            "Empire", "Silent", "Glass", "Harbor", "Crown", "Ember",
+                            "Forest", "Mirror", "Storm", "Letters"};
+const char *suiteNames[] = {"Smith", "Karimov", "Garcia", "Chen", "Novak", "Okafor",
+                            "Rossi", "Tanaka", "Haddad", "Larsen", "Silva", "Ivanova"};
+
+inline void writeSyntheticCatalog(const string &path, int n) {
+    FILE *f = fopen(path.c_str(), "w");
+    Rng rng(101);
+    for (int id = 1; id <= n; ++id) {
+        fprintf(f, "%d|%s of the %s %s %d|%s %s|%d|", id, suiteWords[rng.below(16)],
+                suiteWords[rng.below(16)], suiteWords[rng.below(16)], id % 1000,
+                suiteNames[rng.below(12)], suiteNames[rng.below(12)], 1 + id % 5);
+        fprintf(f, "%d\n", 1 + id % 5);
+    }
+    fclose(f);
+}
+
+void suiteForSize(int n) {
+    const string path = "suite_books.txt", usersPath = "suite_users.txt";
+    removeLibraryFiles(path);
+    writeSyntheticCatalog(path, n);
+    const Date day0(1, 1, 2024);
+
+    {
+        Library lib(path);
+        Latencies load;
+        load.start();
+        lib.loadFromFile();
+        load.stop();
+        load.report("load_text", n);
+
+        // loan history: a loan on every tenth book, half of them returned
+        Rng rng(202);
+        int loans = n / 10;
+        Latencies issue;
+        lib.beginBatch();
+        for (int i = 0; i < loans; ++i) {
+            int id = 1 + rng.below(n);
+            Date d = addDays(day0, rng.below(365));
+            issue.start();
+            lib.issue(id, "st" + to_string(rng.below(n / 10 + 1)), d);
+            issue.stop();
+        }
+        lib.endBatch();
+        issue.report("issue_history", n);
+
+        Latencies save;
+        save.start();
+        lib.saveToFile();
+        save.stop();
+        save.report("save_journal", n);
+
+        Latencies snap;
+        snap.start();
+        lib.writeSnapshot();
+        snap.stop();
+        snap.report("save_snapshot", n);
+    }
+
+    Library lib(path);
+    Latencies load;
+    load.start();
+    lib.loadFromFile();
+    load.stop();
+    load.report("load_snapshot", n);
+
+    Rng rng(303);
+    Latencies byId;
+    long long sink = 0;
+    for (int i = 0; i < 200000; ++i) {
+        int id = 1 + rng.below(n);
+        byId.start();
+        BookNode *b = lib.findById(id);
+        byId.stop();
+        sink += b != NULL ? b->totalCopies : 0;
+    }
+    byId.report("find_by_id", n);
+
+    Latencies build;
+    build.start();
+    lib.findByTitle("warm-up");
+    build.stop();
+    build.report("search_index_build", n);
+
+    Latencies title, author;
+    for (int i = 0; i < 200; ++i) {
+        string q;
+        switch (i % 4) {
+            case 0: q = suiteWords[rng.below(16)]; break;
+            case 1: q = string(suiteWords[rng.below(16)]) + " of"; break;
+            case 2: q = "the " + string(suiteWords[rng.below(16)]) + " "; break;
+            default: q = " " + to_string(rng.below(1000)); break;
+        }
+        title.start();
+        sink += lib.findByTitle(q).size();
+        title.stop();
+        q = i % 2 ? string(suiteNames[rng.below(12)]) : string(suiteNames[rng.below(12)]).substr(0, 3);
+        author.start();
+        sink += lib.findByAuthor(q).size();
+        author.stop();
+    }
+    title.report("search_title", n);
+    author.report("search_author", n);
+
+    // churn: hot single-copy books with long waiting queues; each return
+    // hands the copy to the front, and the returner joins the back again
+    const int hot = 64, queueLen = 1000;
+    vector<int> hotIds;
+    for (int i = 0; i < hot; ++i) {
+        int id = n + 1 + i;
+        lib.addBook(id, "Hot " + to_string(i), "Popular", 1);
+        hotIds.push_back(id);
+    }
+    lib.beginBatch();
+    vector<vector<string> > holders(hot);
+    for (int h = 0; h < hot; ++h) {
+        for (int q = 0; q <= queueLen; ++q) {
+            string sid = "q" + to_string(h) + "_" + to_string(q);
+            lib.issue(hotIds[h], sid, day0);
+            holders[h].push_back(sid);
+        }
+    }
+    lib.endBatch();
+    Latencies ret, rejoin;
+    vector<size_t> front(hot, 0);
+    const int rounds = 100000;
+    for (int r = 0; r < rounds; ++r) {
+        if (r % 1000 == 0) lib.beginBatch();
+        int h = r % hot;
+        string &holder = holders[h][front[h]];
+        Date d = addDays(day0, 1 + r / hot);
+        ret.start();
+        ReturnResult rr = lib.returnBook(hotIds[h], holder, d);
+        ret.stop();
+        rejoin.start();
+        lib.issue(hotIds[h], holder, d);
+        rejoin.stop();
+        sink += rr.fine;
+        front[h] = (front[h] + 1) % holders[h].size();
+        if (r % 1000 == 999) lib.endBatch();
+    }
+    ret.report("churn_return", n);
+    rejoin.report("churn_enqueue", n);
+
+    int userCount = n / 10 < 1000 ? 1000 : (n / 10 > 1000000 ? 1000000 : n / 10);
+    FILE *f = fopen(usersPath.c_str(), "w");
+    for (int i = 0; i < userCount; ++i) fprintf(f, "u%07d|pw%d|STUDENT\n", i, i);
+    fclose(f);
+    AuthSystem auth(usersPath);
+    Latencies login;
+    {
+        ScriptedConsole console;
+        User user;
+        char line[48];
+        for (int i = 0; i < 20000; ++i) {
+            int u = rng.below(userCount);
+            snprintf(line, sizeof(line), "u%07d\npw%d\n", u, u);
+            console.feed(line);
+            login.start();
+            sink += auth.login(user);
+            login.stop();
+        }
+    }
+    login.report("login", n);
+
+    if (sink == 42) fprintf(stderr, " ");
+    remove(usersPath.c_str());
+    removeLibraryFiles(path);
+}
+
+void benchSuite(int maxBooks) {
+    for (int n = 10000; n <= maxBooks; n *= 10) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            suiteForSize(n);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        if (pid > 0) waitpid(pid, &status, 0);
+        if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "suite: size %d failed\n", n);
+        }
+    }
+}
+
+// ---------- server: throughput vs client threads ----------
+// Load generator for Main --server: one session per client thread, each
+// sending requests back to back for a fixed time.
+struct BenchClient {
+    int fd;
+    string buf;
+
+    BenchClient() : fd(-1) {}
+    ~BenchClient() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool connectTo(const string &path) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        return fd >= 0 && ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    // Sends one request, reads the reply up to its "." line and returns the
+    // status line.
+    string call(const string &line) {
+        string req = line + "\n";
+        if (::send(fd, req.data(), req.size(), MSG_NOSIGNAL) != (ssize_t)req.size()) return "";
+        buf.clear();
+        char chunk[65536];
+        while (buf.size() < 2 || buf.compare(buf.size() - 2, 2, ".\n") != 0 ||
+               (buf.size() > 2 && buf[buf.size() - 3] != '\n')) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return "";
+            buf.append(chunk, (size_t)n);
+        }
+        return buf.substr(0, buf.find('\n'));
+    }
+};
+
+void serverClient(const string &path, int seed, bool mutate, double seconds,
+                  int books, long long *opsOut) {
+    BenchClient c;
+    long long ops = 0;
+    if (c.connectTo(path) && c.call("LOGIN lib lib") == "OK LIBRARIAN") {
+        Rng rng(seed);
+        vector<int> held;
+        string student = "c" + to_string(seed);
+        Clock::time_point t0 = Clock::now();
+        while (secondsSince(t0) < seconds) {
+            for (int k = 0; k < 64; ++k, ++ops) {
+                int r = rng.below(100);
+                if (mutate && r < 15) {
+                    int id = 1 + rng.below(books);
+                    if (c.call("ISSUE " + to_string(id) + " 1 1 2025 " + student)
+                            .compare(0, 9, "OK ISSUED") == 0) held.push_back(id);
+                } else if (mutate && r < 30 && !held.empty()) {
+                    c.call("RETURN " + to_string(held.back()) + " 10 1 2025 " + student);
+                    held.pop_back();
+                } else if (r < 85) {
+                    c.call("FIND " + to_string(1 + rng.below(books)));
+                } else {
+                    c.call("TITLE Title " + to_string(10000 + rng.below(books - 10000)));
+                }
+            }
+        }
+    }
+    *opsOut = ops;
+}
+
+void benchServer(int maxThreads) {
+    const string path = "bench_server_books.txt", usersPath = "bench_server_users.txt";
+    const string sock = "bench_server.sock";
+    const int books = 100000;
+    cout << "== server: requests/s vs client sessions (Unix socket) ==\n";
+    removeLibraryFiles(path);
+    writeCatalogFile(path, books);
+    FILE *f = fopen(usersPath.c_str(), "w");
+    fprintf(f, "lib|lib|LIBRARIAN\n");
+    fclose(f);
+
+    AuthSystem auth(usersPath);
+    Library lib(path);
+    lib.loadFromFile();
+    LibraryServer server(lib, auth, sock);
+    if (!server.start()) {
+        cout << "cannot listen on " << sock << "\n";
+        return;
+    }
+    thread serving(&LibraryServer::serve, &server);
+
+    for (int mix = 0; mix < 2; ++mix) {
+        double base = 0;
+        for (int t = 1; t <= maxThreads; t *= 2) {
+            vector<long long> ops(t, 0);
+            vector<thread> clients;
+            for (int i = 0; i < t; ++i) {
+                clients.push_back(thread(serverClient, sock, 1000 * mix + 100 * t + i + 1,
+                                         mix == 1, 1.0, books, &ops[i]));
+            }
+            long long total = 0;
+            for (int i = 0; i < t; ++i) {
+                clients[i].join();
+                total += ops[i];
+            }
+            if (t == 1) base = (double)total;
+            printf("%-10s sessions=%-3d %9.0f req/s  scaling=%.2fx\n",
+                   mix == 0 ? "read-only" : "mixed", t, (double)total,
+                   base > 0 ? total / base : 0.0);
+        }
+    }
+
+    server.stop();
+    serving.join();
+    remove(usersPath.c_str());
+    removeLibraryFiles(path);
+}
+
+// ---------- snapshot reads: full scans against a saturated writer ----------
+// One writer issues and returns as fast as it can (no journal, so it is CPU
+// bound) while readers scan the whole catalog, either the old way (each
+// book read under its stripe lock) or through Library::ReadSnapshot. Every
+// row a reader sees is checked: 0 <= available <= total, and nobody waits
+// while a copy is free.
+void mvccWriter(Library *lib, shared_mutex *cat, mutex *stripes, atomic<bool> *stop,
+                int books, long long *opsOut) {
+    Rng rng(42);
+    string students[8];
+    for (int i = 0; i < 8; ++i) students[i] = "w" + to_string(i);
+    long long ops = 0;
+    while (!stop->load()) {
+        int id = 1 + rng.below(books);
+        const string &st = students[rng.below(8)];
+        shared_lock<shared_mutex> g(*cat);
+        lock_guard<mutex> b(stripes[(unsigned)id % 256]);
+        if (lib->hasIssued(lib->findById(id), st)) lib->returnBook(id, st, Date(5, 1, 2025));
+        else lib->issue(id, st, Date(1, 1, 2025));
+        ++ops;
+    }
+    *opsOut = ops;
+}
+
+void mvccReader(Library *lib, shared_mutex *cat, mutex *stripes, bool snapshot,
+                atomic<bool> *stop, long long *rowsOut, long long *badOut) {
+    long long rows = 0, bad = 0;
+    while (!stop->load()) {
+        shared_lock<shared_mutex> g(*cat);
+        Library::ReadSnapshot snap(*lib);
+        for (BookNode *b = lib->firstBook(); b != NULL; b = b->next) {
+            int available, waiting;
+            if (snapshot) {
+                if (!snap.counts(b, available, waiting)) continue;
+            } else {
+                lock_guard<mutex> s(stripes[(unsigned)b->id % 256]);
+                available = b->availableCopies;
+                waiting = b->waitingCount();
+            }
+            if (available < 0 || available > b->totalCopies || (waiting > 0 && available > 0)) ++bad;
+            ++rows;
+        }
+    }
+    *rowsOut = rows;
+    *badOut = bad;
+}
+
+void benchMvcc(int maxReaders) {
+    const int books = 20000;
+    const double seconds = 1.0;
+    cout << "== snapshot reads: catalog scans vs a saturated issue/return writer ==\n";
+    printf("(%u cores)\n", thread::hardware_concurrency());
+    for (int mode = 0; mode < 2; ++mode) {
+        for (int t = 1; t <= maxReaders; t *= 2) {
+            Library lib("bench_mvcc_books.txt");
+            vector<BookNode*> nodes;
+            for (int id = 1; id <= books; ++id) {
+                nodes.push_back(lib.newBook(id, "Title " + to_string(id), "Author", 2, 2));
+            }
+            lib.bulkInsert(nodes);
+            lib.setConcurrent(true);
+            shared_mutex cat;
+            vector<mutex> stripes(256);
+            atomic<bool> stop(false);
+            long long writes = 0;
+            vector<long long> rows(t, 0), bad(t, 0);
+            thread writer(mvccWriter, &lib, &cat, &stripes[0], &stop, books, &writes);
+            vector<thread> readers;
+            for (int i = 0; i < t; ++i) {
+                readers.push_back(thread(mvccReader, &lib, &cat, &stripes[0], mode == 1,
+                                         &stop, &rows[i], &bad[i]));
+            }
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            stop = true;
+            writer.join();
+            long long totalRows = 0, totalBad = 0;
+            for (int i = 0; i < t; ++i) {
+                readers[i].join();
+                totalRows += rows[i];
+                totalBad += bad[i];
+            }
+            printf("%-8s readers=%-3d rows=%10.0f/s  writes=%9.0f/s  bad rows=%lld  "
+                   "versions=%zu\n",
+                   mode == 0 ? "locked" : "snapshot", t, totalRows / seconds,
+                   writes / seconds, totalBad, lib.bookVersionCount());
+            lib.setConcurrent(false);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    string which = argc > 1 ? argv[1] : "";
+    bool all = which.empty();
+
+    if (which == "suite") {
+        benchSuite(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (which == "pipeline") {
+        int cores = (int)thread::hardware_concurrency();
+        benchPipeline(argc > 2 ? atoi(argv[2]) : (cores > 0 ? cores : 4));
+        return 0;
+    }
+    if (which == "mvcc") {
+        int cores = (int)thread::hardware_concurrency();
+        benchMvcc(argc > 2 ? atoi(argv[2]) : (cores > 0 ? cores : 4));
+        return 0;
+    }
+    if (which == "server") {
+        int cores = (int)thread::hardware_concurrency();
+        benchServer(argc > 2 ? atoi(argv[2]) : (cores > 0 ? cores : 4));
+        return 0;
+    }
+
+    if (all || which == "idindex") benchIdIndex();
+    if (all || which == "order") benchOrder();
+    if (all || which == "load") benchLoad();
+    if (all || which == "snapshot") benchSnapshot();
+    if (all || which == "search") benchSearch();
+    if (all || which == "fuzzy") benchFuzzy();
+    if (all || which == "prefix") benchPrefix();
+    if (all || which == "churn") benchChurn();
+    if (all || which == "queue") benchQueue();
+    if (all || which == "overdue") benchOverdue();
+    if (all || which == "dates") benchDates();
+    if (all || which == "journal") benchJournal();
+    if (all || which == "save") benchSave();
+    if (all || which == "display") benchDisplay();
+    if (all || which == "auth") benchAuth();
+    if (all || which == "metrics") benchMetrics();
+    if (all || which == "strings") benchStrings();
+    if (all || which == "students") benchStudents();
+    if (all || which == "teardown") benchTeardown();
+    return 0;
+}
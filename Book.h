@@ -3,8 +3,12 @@
 
 #include <iostream>
 #include <string>
-#include <sstream>
 #include <iomanip>
+#include <vector>
+#include <cstdio>
+#include "StringPool.h"
+#include "StudentRegistry.h"
+#include "BookVersions.h"
 using namespace std;
 
 // ========================= DATE UTILITIES =========================
@@ -14,46 +18,76 @@ struct Date {
     int month;
     int year;
 
-    Date() : day(1), month(1), year(2000) {}
+    constexpr Date() : day(1), month(1), year(2000) {}
+    constexpr Date(int d, int m, int y) : day(d), month(m), year(y) {}
 };
 
-inline bool isLeap(int y) {
+constexpr bool isLeap(int y) {
     return (y % 4 == 0 && y % 100 != 0) || (y % 400 == 0);
 }
 
-inline int daysFromStart(const Date &d) {
-    static int monthDays[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
-    long long days = (long long)d.year * 365LL + d.day;
+constexpr int daysInMonth(int y, int m) {
+    return m == 2 ? (isLeap(y) ? 29 : 28)
+                  : (m == 4 || m == 6 || m == 9 || m == 11) ? 30 : 31;
+}
 
-    for (int m = 1; m < d.month; ++m) {
-        days += monthDays[m-1];
-        if (m == 2 && isLeap(d.year)) days += 1;
-    }
-    int y = d.year - 1;
-    days += y/4 - y/100 + y/400;
-    return (int)days;
+// Day number: days since 01/01/1970 in the proleptic Gregorian calendar.
+// Closed-form conversions (H. Hinnant's civil-date algorithms), no loops.
+// A day past the end of its month simply counts on into the next month.
+constexpr int dayNumber(const Date &d) {
+    int y = d.year - (d.month <= 2 ? 1 : 0);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;                                        // [0, 399]
+    int doy = (153 * (d.month + (d.month > 2 ? -3 : 9)) + 2) / 5 + d.day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                // [0, 146096]
+    return era * 146097 + doe - 719468;
+}
+
+constexpr Date dateFromDays(int z) {
+    int s = z + 719468;
+    int era = (s >= 0 ? s : s - 146096) / 146097;
+    int doe = s - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int m = mp + (mp < 10 ? 3 : -9);
+    return Date(doy - (153 * mp + 2) / 5 + 1, m, yoe + era * 400 + (m <= 2 ? 1 : 0));
 }
 
-inline int daysBetween(const Date &from, const Date &to) {
-    return daysFromStart(to) - daysFromStart(from);
+static_assert(dayNumber(Date(1, 1, 1970)) == 0, "day number epoch");
+static_assert(dateFromDays(dayNumber(Date(29, 2, 2024))).day == 29, "leap day round trip");
+
+// Day count since year 0; same values as the original month-by-month loop.
+constexpr int daysFromStart(const Date &d) {
+    return dayNumber(d) + 719528;
+}
+
+constexpr int daysBetween(const Date &from, const Date &to) {
+    return dayNumber(to) - dayNumber(from);
 }
 
 inline Date addDays(const Date &start, int add) {
     Date d = start;
-    static int monthDays[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
     d.day += add;
-    while (true) {
-        int md = monthDays[d.month-1];
-        if (d.month == 2 && isLeap(d.year)) md = 29;
-        if (d.day <= md) break;
-        d.day -= md;
-        d.month++;
-        if (d.month > 12) {
-            d.month = 1;
-            d.year++;
-        }
-    }
-    return d;
+    if (d.day <= daysInMonth(d.year, d.month)) return d;
+    return dateFromDays(dayNumber(start) + add);
+}
+
+// Compact yyyymmdd form used in the journal
+inline int dateToKey(const Date &d) {
+    return d.year * 10000 + d.month * 100 + d.day;
+}
+
+inline Date keyToDate(int key) {
+    return Date(key % 100, key / 100 % 100, key / 10000);
+}
+
+inline int keyToDay(int key) {
+    return dayNumber(keyToDate(key));
+}
+
+inline int dayToKey(int day) {
+    return dateToKey(dateFromDays(day));
 }
 
 inline void printDate(const Date &d) {
@@ -63,10 +97,15 @@ inline void printDate(const Date &d) {
          << setw(4) << d.year << setfill(' ');
 }
 
+// What inputDate accepts (a day past the end of the month rolls over)
+inline bool isValidDate(const Date &d) {
+    return d.day > 0 && d.month > 0 && d.month <= 12 && d.year > 0;
+}
+
 inline void inputDate(Date &d, const string &prompt) {
     cout << prompt;
     cin >> d.day >> d.month >> d.year;
-    while (cin.fail() || d.day <= 0 || d.month <= 0 || d.month > 12 || d.year <= 0) {
+    while (cin.fail() || !isValidDate(d)) {
         cin.clear();
         cin.ignore(10000, '\n');
         cout << "Invalid date, try again (dd mm yyyy): ";
@@ -74,60 +113,166 @@ inline void inputDate(Date &d, const string &prompt) {
     }
 }
 
+struct BookNode;
+struct StudentEntry;
+
 // ========================= WAITING QUEUE =========================
 
 struct WaitNode {
-    string studentId;
+    StudentId student;          // name via the library's StudentRegistry
     WaitNode *next;
-    WaitNode(const string &id) : studentId(id), next(NULL) {}
+    long long ticket;           // n-th student ever queued for this book
+
+    // Also linked into the student's own list (see StudentEntry)
+    BookNode *book;
+    StudentEntry *owner;
+    WaitNode *studentPrev;
+    WaitNode *studentNext;
+
+    WaitNode(StudentId s)
+            : student(s), next(NULL), ticket(0), book(NULL), owner(NULL),
+              studentPrev(NULL), studentNext(NULL) {}
 };
 
 // ========================= ISSUED RECORD =========================
 
 struct IssuedRecord {
-    string studentId;
-    Date issueDate;
-    Date dueDate;
+    StudentId student;
+    int issueDay;               // day numbers (see dayNumber)
+    int dueDay;                 // also the due-index key
+    int heapPos;                // slot in the due index, -1 if not in it
     IssuedRecord *next;
 
-    IssuedRecord(const string &sid, const Date &iss, const Date &due)
-            : studentId(sid), issueDate(iss), dueDate(due), next(NULL) {}
+    // Also linked into the student's own list (see StudentEntry)
+    BookNode *book;
+    StudentEntry *owner;
+    IssuedRecord *studentPrev;
+    IssuedRecord *studentNext;
+
+    IssuedRecord(StudentId s, int iss, int due)
+            : student(s), issueDay(iss), dueDay(due), heapPos(-1), next(NULL),
+              book(NULL), owner(NULL), studentPrev(NULL), studentNext(NULL) {}
+
+    Date issueDate() const { return dateFromDays(issueDay); }
+    Date dueDate() const { return dateFromDays(dueDay); }
+};
+
+// ========================= PER-STUDENT INDEX =========================
+// Each student's active loans and queue places, as doubly linked lists
+// threaded through the same IssuedRecord / WaitNode objects the books use,
+// so "what does this student hold" is O(k) and unlinking is O(1).
+
+struct StudentEntry {
+    IssuedRecord *loans;
+    WaitNode *waits;
+    int loanCount;
+    int waitCount;
+    bool used;              // has had a loan or queue place
+
+    StudentEntry() : loans(NULL), waits(NULL), loanCount(0), waitCount(0), used(false) {}
+};
+
+// Entries indexed by StudentId (ids are dense), in blocks that never move:
+// an entry's address stays valid, and a new student costs an allocation
+// only once per BLOCK ids.
+class StudentTable {
+    enum { BLOCK = 4096 };
+
+    vector<StudentEntry*> blocks;
+    size_t used;
+
+    StudentTable(const StudentTable&);
+    StudentTable& operator=(const StudentTable&);
+
+public:
+    StudentTable() : used(0) {}
+
+    ~StudentTable() {
+        for (size_t i = 0; i < blocks.size(); ++i) delete[] blocks[i];
+    }
+
+    // Makes room for ids below count up front
+    void reserve(size_t count) {
+        while (blocks.size() * BLOCK < count) blocks.push_back(new StudentEntry[BLOCK]);
+    }
+
+    // The student's entry, marked used
+    StudentEntry& at(StudentId id) {
+        reserve((size_t)id + 1);
+        StudentEntry &e = blocks[id / BLOCK][id % BLOCK];
+        if (!e.used) {
+            e.used = true;
+            ++used;
+        }
+        return e;
+    }
+
+    // NULL if the student never had a loan or queue place
+    const StudentEntry* find(StudentId id) const {
+        if (id / BLOCK >= blocks.size()) return NULL;
+        const StudentEntry &e = blocks[id / BLOCK][id % BLOCK];
+        return e.used ? &e : NULL;
+    }
+
+    size_t size() const { return used; }
+    size_t memoryBytes() const { return blocks.size() * BLOCK * sizeof(StudentEntry); }
 };
 
+template <class T>
+inline void linkStudent(T *&first, int &count, T *node) {
+    node->studentPrev = NULL;
+    node->studentNext = first;
+    if (first != NULL) first->studentPrev = node;
+    first = node;
+    ++count;
+}
+
+template <class T>
+inline void unlinkStudent(T *&first, int &count, T *node) {
+    if (node->studentPrev != NULL) node->studentPrev->studentNext = node->studentNext;
+    else first = node->studentNext;
+    if (node->studentNext != NULL) node->studentNext->studentPrev = node->studentPrev;
+    node->studentPrev = node->studentNext = NULL;
+    --count;
+}
+
 // ========================= BOOK NODE (LINKED LIST) =========================
 
 struct BookNode {
     int id;
-    string title;
-    string author;
+    StrRef title;           // bytes live in the library's StringPool
+    StrRef author;
     int totalCopies;
     int availableCopies;
 
     WaitNode *waitFront;
     WaitNode *waitRear;
+    int waitCount;
+    long long waitTickets;      // tickets handed out to queued students
+    long long waitServed;       // tickets that reached the front and left
 
     IssuedRecord *issuedHead;
 
+    // Counts as last published for snapshot readers (concurrent mode only)
+    atomic<const BookVersion*> version;
+
     BookNode *next;
 
-    BookNode(int _id, const string &_title, const string &_author,
+    BookNode(int _id, StrRef _title, StrRef _author,
              int total, int avail)
             : id(_id), title(_title), author(_author),
               totalCopies(total), availableCopies(avail),
               waitFront(NULL), waitRear(NULL),
-              issuedHead(NULL), next(NULL) {}
-
-    bool isStudentInQueue(const string &studentId) const {
-        WaitNode *cur = waitFront;
-        while (cur != NULL) {
-            if (cur->studentId == studentId) return true;
-            cur = cur->next;
+              waitCount(0), waitTickets(0), waitServed(0),
+              issuedHead(NULL), version(NULL), next(NULL) {}
+
+    void enqueueWait(WaitNode *node) {
+        node->book = this;
+        node->ticket = waitTickets++;
+        ++waitCount;
+        if (node->owner != NULL) {
+            linkStudent(node->owner->waits, node->owner->waitCount, node);
         }
-        return false;
-    }
-
-    void enqueueWait(const string &studentId) {
-        WaitNode *node = new WaitNode(studentId);
         if (waitRear == NULL) {
             waitFront = waitRear = node;
         } else {
@@ -136,43 +281,53 @@ struct BookNode {
         }
     }
 
-    bool dequeueWait(string &studentIdOut) {
-        if (waitFront == NULL) return false;
+    // Unlinks and returns the front of the queue (NULL if empty); the
+    // caller gives the node back to its pool.
+    WaitNode* dequeueWait() {
+        if (waitFront == NULL) return NULL;
         WaitNode *node = waitFront;
-        studentIdOut = node->studentId;
         waitFront = waitFront->next;
         if (waitFront == NULL) waitRear = NULL;
-        delete node;
-        return true;
+        node->next = NULL;
+        --waitCount;
+        ++waitServed;
+        if (node->owner != NULL) {
+            unlinkStudent(node->owner->waits, node->owner->waitCount, node);
+        }
+        return node;
     }
 
     int waitingCount() const {
-        int c = 0;
-        WaitNode *cur = waitFront;
-        while (cur != NULL) {
-            ++c;
-            cur = cur->next;
-        }
-        return c;
+        return waitCount;
     }
 
-    IssuedRecord* findIssued(const string &studentId) {
+    // 1-based place of a node in this queue; only the front ever leaves,
+    // so it is the node's ticket minus the tickets already served.
+    int queuePosition(const WaitNode *node) const {
+        return (int)(node->ticket - waitServed) + 1;
+    }
+
+    IssuedRecord* findIssued(StudentId student) const {
         IssuedRecord *cur = issuedHead;
         while (cur != NULL) {
-            if (cur->studentId == studentId) return cur;
+            if (cur->student == student) return cur;
             cur = cur->next;
         }
         return NULL;
     }
 
-    bool removeIssued(const string &studentId, IssuedRecord* &removed) {
+    bool removeIssued(StudentId student, IssuedRecord* &removed) {
         removed = NULL;
         IssuedRecord *cur = issuedHead;
         IssuedRecord *prev = NULL;
         while (cur != NULL) {
-            if (cur->studentId == studentId) {
+            if (cur->student == student) {
                 if (prev != NULL) prev->next = cur->next;
                 else issuedHead = cur->next;
+                cur->next = NULL;
+                if (cur->owner != NULL) {
+                    unlinkStudent(cur->owner->loans, cur->owner->loanCount, cur);
+                }
                 removed = cur;
                 return true;
             }
@@ -182,71 +337,159 @@ struct BookNode {
         return false;
     }
 
-    void addIssued(const string &studentId, const Date &issueD, const Date &dueD) {
-        IssuedRecord *rec = new IssuedRecord(studentId, issueD, dueD);
+    void addIssued(IssuedRecord *rec) {
+        rec->book = this;
+        if (rec->owner != NULL) {
+            linkStudent(rec->owner->loans, rec->owner->loanCount, rec);
+        }
         rec->next = issuedHead;
         issuedHead = rec;
     }
 
-    void printBrief() const {
-        cout << "ID: " << id
-             << " | Title: " << title
-             << " | Author: " << author
-             << " | Total: " << totalCopies
-             << " | Available: " << availableCopies;
-        int wc = waitingCount();
-        if (wc > 0) {
-            cout << " | Waiting: " << wc;
+    // One display row ("ID: .. | Title: .. | ..\n"), appended to out
+    void appendBrief(string &out) const {
+        char num[48];
+        out.append(num, snprintf(num, sizeof(num), "ID: %d | Title: ", id));
+        out += title;
+        out += " | Author: ";
+        out += author;
+        out.append(num, snprintf(num, sizeof(num), " | Total: %d | Available: %d",
+                                 totalCopies, availableCopies));
+        if (waitCount > 0) {
+            out.append(num, snprintf(num, sizeof(num), " | Waiting: %d", waitCount));
         }
-        cout << "\n";
+        out += '\n';
     }
 
-    string toFileLine() const {
-        ostringstream oss;
-        oss << id << "|" << title << "|" << author
-            << "|" << totalCopies << "|" << availableCopies;
-        return oss.str();
+    void printBrief() const {
+        string row;
+        appendBrief(row);
+        cout.write(row.data(), (streamsize)row.size());
     }
 
-    static BookNode* fromFileLine(const string &line) {
-        stringstream ss(line);
-        string part;
-        int id, total, avail;
-        string title, author;
+    // "id|title|author|total|avail", appended to out (no trailing newline)
+    void appendFileLine(string &out) const {
+        appendFileLine(out, availableCopies);
+    }
 
-        getline(ss, part, '|');
-        if (part.empty()) return NULL;
-        id = atoi(part.c_str());
+    // The same with avail as read from a snapshot
+    void appendFileLine(string &out, int available) const {
+        appendFileLine(out, id, title, author, totalCopies, available);
+    }
 
-        getline(ss, title, '|');
-        getline(ss, author, '|');
+    static void appendFileLine(string &out, int id, string_view title, string_view author,
+                               int total, int avail) {
+        char num[16];
+        out.append(num, snprintf(num, sizeof(num), "%d|", id));
+        out += title;
+        out += '|';
+        out += author;
+        out.append(num, snprintf(num, sizeof(num), "|%d", total));
+        out.append(num, snprintf(num, sizeof(num), "|%d", avail));
+    }
 
-        getline(ss, part, '|');
-        total = atoi(part.c_str());
+    string toFileLine() const {
+        string line;
+        appendFileLine(line);
+        return line;
+    }
 
-        getline(ss, part, '|');
-        avail = atoi(part.c_str());
+    // ---------- export rows ----------
+    // TSV: id, title, author, total, available, waiting. Tab, newline, CR
+    // and backslash inside text are written as \t \n \r \\.
+    static void appendTsvText(string &out, string_view s) {
+        for (size_t i = 0; i < s.size(); ++i) {
+            char c = s[i];
+            if (c == '\t') out += "\\t";
+            else if (c == '\n') out += "\\n";
+            else if (c == '\r') out += "\\r";
+            else if (c == '\\') out += "\\\\";
+            else out += c;
+        }
+    }
 
-        return new BookNode(id, title, author, total, avail);
+    void appendTsvLine(string &out) const {
+        char num[48];
+        out.append(num, snprintf(num, sizeof(num), "%d\t", id));
+        appendTsvText(out, title);
+        out += '\t';
+        appendTsvText(out, author);
+        out.append(num, snprintf(num, sizeof(num), "\t%d\t%d\t%d\n",
+                                 totalCopies, availableCopies, waitCount));
     }
-};
 
-inline void freeBookList(BookNode *head) {
-    while (head != NULL) {
-        BookNode *next = head->next;
-        while (head->waitFront != NULL) {
-            WaitNode *wn = head->waitFront;
-            head->waitFront = wn->next;
-            delete wn;
+    // JSON string contents; bytes >= 0x80 are passed through as UTF-8.
+    static void appendJsonText(string &out, string_view s) {
+        for (size_t i = 0; i < s.size(); ++i) {
+            unsigned char c = (unsigned char)s[i];
+            if (c == '"') out += "\\\"";
+            else if (c == '\\') out += "\\\\";
+            else if (c == '\n') out += "\\n";
+            else if (c == '\t') out += "\\t";
+            else if (c < 0x20) {
+                char esc[8];
+                out.append(esc, snprintf(esc, sizeof(esc), "\\u%04x", c));
+            } else {
+                out += (char)c;
+            }
         }
-        while (head->issuedHead != NULL) {
-            IssuedRecord *ir = head->issuedHead;
-            head->issuedHead = ir->next;
-            delete ir;
+    }
+
+    void appendJsonLine(string &out) const {
+        char num[96];
+        out.append(num, snprintf(num, sizeof(num), "{\"id\":%d,\"title\":\"", id));
+        appendJsonText(out, title);
+        out += "\",\"author\":\"";
+        appendJsonText(out, author);
+        out.append(num, snprintf(num, sizeof(num),
+                                 "\",\"total\":%d,\"available\":%d,\"waiting\":%d}\n",
+                                 totalCopies, availableCopies, waitCount));
+    }
+
+    // Parses "id|title|author|total|avail" in place. Numbers follow atoi
+    // rules (leading spaces, optional sign, stop at the first non-digit);
+    // missing fields are left empty / zero. Title and author point into
+    // the line. Returns false if id is empty.
+    static bool parseFileLine(const char *p, const char *end,
+                              int &id, string_view &title, string_view &author,
+                              int &total, int &avail) {
+        const char *fields[5][2];
+        int n = 0;
+        const char *start = p;
+        while (n < 5) {
+            const char *bar = p;
+            while (bar != end && *bar != '|') ++bar;
+            fields[n][0] = start;
+            fields[n][1] = bar;
+            ++n;
+            if (bar == end) break;
+            p = start = bar + 1;
         }
-        delete head;
-        head = next;
+        for (int i = n; i < 5; ++i) fields[i][0] = fields[i][1] = end;
+
+        if (fields[0][0] == fields[0][1]) return false;
+        id = parseInt(fields[0][0], fields[0][1]);
+        title = string_view(fields[1][0], fields[1][1] - fields[1][0]);
+        author = string_view(fields[2][0], fields[2][1] - fields[2][0]);
+        total = parseInt(fields[3][0], fields[3][1]);
+        avail = parseInt(fields[4][0], fields[4][1]);
+        return true;
     }
-}
+
+    static int parseInt(const char *p, const char *end) {
+        while (p != end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) ++p;
+        bool neg = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            neg = (*p == '-');
+            ++p;
+        }
+        int v = 0;
+        while (p != end && *p >= '0' && *p <= '9') {
+            v = v * 10 + (*p - '0');
+            ++p;
+        }
+        return neg ? -v : v;
+    }
+};
 
 #endif // BOOK_H
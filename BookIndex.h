@@ -0,0 +1,486 @@
+#ifndef BOOK_INDEX_H
+#define BOOK_INDEX_H
+
+#include "Book.h"
+#include <vector>
+using namespace std;
+
+// ========================= BOOK ID INDEX (HASH TABLE) =========================
+// Open addressing with linear probing. Maps book id -> BookNode* so that
+// findById does not have to walk the whole linked list.
+
+class BookIdIndex {
+    struct Slot {
+        int id;
+        BookNode *node;     // NULL = empty, TOMBSTONE = deleted
+    };
+
+    vector<Slot> slots;
+    size_t mask;
+    size_t count;           // live entries
+    size_t used;            // live entries + tombstones
+
+    static BookNode* tombstone() {
+        return reinterpret_cast<BookNode*>(1);
+    }
+
+    size_t slotFor(int id) const {
+        unsigned long long h = (unsigned int)id * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(h >> 32) & mask;
+    }
+
+    void rehash(size_t newCap) {
+        vector<Slot> old;
+        old.swap(slots);
+        Slot empty = {0, NULL};
+        slots.assign(newCap, empty);
+        mask = newCap - 1;
+        count = used = 0;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (old[i].node != NULL && old[i].node != tombstone()) {
+                put(old[i].id, old[i].node);
+            }
+        }
+    }
+
+    void put(int id, BookNode *node) {
+        size_t i = slotFor(id);
+        while (slots[i].node != NULL) i = (i + 1) & mask;
+        slots[i].id = id;
+        slots[i].node = node;
+        ++count;
+        ++used;
+    }
+
+public:
+    BookIdIndex() : mask(0), count(0), used(0) {
+        rehash(16);
+    }
+
+    size_t size() const { return count; }
+
+    void clear() {
+        slots.clear();
+        rehash(16);
+    }
+
+    // Grow so that n entries fit without further rehashing
+    void reserve(size_t n) {
+        size_t cap = slots.size();
+        while (cap * 7 < n * 10) cap *= 2;
+        if (cap != slots.size()) rehash(cap);
+    }
+
+    BookNode* find(int id) const {
+        size_t i = slotFor(id);
+        while (slots[i].node != NULL) {
+            if (slots[i].node != tombstone() && slots[i].id == id) {
+                return slots[i].node;
+            }
+            i = (i + 1) & mask;
+        }
+        return NULL;
+    }
+
+    // Insert or replace the node stored for node->id
+    void insert(BookNode *node) {
+        size_t i = slotFor(node->id);
+        while (slots[i].node != NULL) {
+            if (slots[i].node != tombstone() && slots[i].id == node->id) {
+                slots[i].node = node;
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        if ((used + 1) * 10 > slots.size() * 7) {
+            // drop tombstones, and double only if live entries need it
+            bool grow = (count + 1) * 2 > slots.size();
+            rehash(grow ? slots.size() * 2 : slots.size());
+        }
+        put(node->id, node);
+    }
+
+    bool erase(int id) {
+        size_t i = slotFor(id);
+        while (slots[i].node != NULL) {
+            if (slots[i].node != tombstone() && slots[i].id == id) {
+                slots[i].node = tombstone();
+                --count;
+                return true;
+            }
+            i = (i + 1) & mask;
+        }
+        return false;
+    }
+};
+
+// ========================= ORDERED ID INDEX (B+TREE) =========================
+// Book id -> BookNode*, ordered, for finding a book's place in the sorted
+// list in O(log n). Nodes hold up to 64 sorted keys in one array, so a
+// lookup touches a few cache lines per level. Range scans need no leaf
+// chain: floor() finds where the range starts and the list's next pointers
+// walk it in order.
+//
+// Deletes only remove a node once it is empty (no merging), so separator
+// keys in inner nodes may be stale low bounds; lookups allow for that.
+
+class BookOrderIndex {
+    enum { FANOUT = 64 };
+
+    struct Node {
+        int count;
+        int keys[FANOUT];           // leaf: ids; inner: lowest id below each child
+        void *slots[FANOUT];        // leaf: BookNode*; inner: Node*
+    };
+
+    Node *root;
+    int height;                     // 1 = root is a leaf
+    size_t count;
+
+    BookOrderIndex(const BookOrderIndex&);
+    BookOrderIndex& operator=(const BookOrderIndex&);
+
+    static Node* child(const Node *n, int i) {
+        return static_cast<Node*>(n->slots[i]);
+    }
+
+    // Last slot whose key is <= id (0 if id is below all of them)
+    static int route(const Node *n, int id) {
+        int lo = 1, hi = n->count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (n->keys[mid] <= id) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo - 1;
+    }
+
+    // First slot whose key is >= id
+    static int lowerSlot(const Node *n, int id) {
+        int lo = 0, hi = n->count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (n->keys[mid] < id) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    static void insertAt(Node *n, int i, int key, void *slot) {
+        for (int j = n->count; j > i; --j) {
+            n->keys[j] = n->keys[j-1];
+            n->slots[j] = n->slots[j-1];
+        }
+        n->keys[i] = key;
+        n->slots[i] = slot;
+        ++n->count;
+    }
+
+    static void eraseAt(Node *n, int i) {
+        for (int j = i + 1; j < n->count; ++j) {
+            n->keys[j-1] = n->keys[j];
+            n->slots[j-1] = n->slots[j];
+        }
+        --n->count;
+    }
+
+    // Moves the upper half of a full node into a new right sibling
+    static Node* split(Node *n) {
+        Node *right = new Node;
+        int half = n->count / 2;
+        right->count = n->count - half;
+        for (int j = 0; j < right->count; ++j) {
+            right->keys[j] = n->keys[half + j];
+            right->slots[j] = n->slots[half + j];
+        }
+        n->count = half;
+        return right;
+    }
+
+    // Returns a new right sibling of n if n had to split, else NULL
+    Node* insertInto(Node *n, int level, int id, BookNode *book) {
+        if (level == 1) {
+            int i = lowerSlot(n, id);
+            if (i < n->count && n->keys[i] == id) {
+                n->slots[i] = book;
+                return NULL;
+            }
+            Node *right = NULL;
+            if (n->count == FANOUT) {
+                right = split(n);
+                if (i > n->count) {
+                    insertAt(right, i - n->count, id, book);
+                    ++count;
+                    return right;
+                }
+            }
+            insertAt(n, i, id, book);
+            ++count;
+            return right;
+        }
+        int i = route(n, id);
+        if (id < n->keys[i]) n->keys[i] = id;
+        Node *grown = insertInto(child(n, i), level - 1, id, book);
+        if (grown == NULL) return NULL;
+        Node *right = NULL;
+        Node *target = n;
+        int at = i + 1;
+        if (n->count == FANOUT) {
+            right = split(n);
+            if (at > n->count) {
+                target = right;
+                at -= n->count;
+            }
+        }
+        insertAt(target, at, grown->keys[0], grown);
+        return right;
+    }
+
+    // True if the key was found; *emptied tells the parent to drop n
+    bool eraseFrom(Node *n, int level, int id, bool *emptied) {
+        *emptied = false;
+        if (level == 1) {
+            int i = lowerSlot(n, id);
+            if (i == n->count || n->keys[i] != id) return false;
+            eraseAt(n, i);
+            --count;
+            *emptied = n->count == 0;
+            return true;
+        }
+        int i = route(n, id);
+        bool childEmpty;
+        if (!eraseFrom(child(n, i), level - 1, id, &childEmpty)) return false;
+        if (childEmpty) {
+            delete child(n, i);
+            eraseAt(n, i);
+            *emptied = n->count == 0;
+        }
+        return true;
+    }
+
+    static BookNode* lastIn(const Node *n, int level) {
+        while (level > 1) {
+            n = child(n, n->count - 1);
+            --level;
+        }
+        return static_cast<BookNode*>(n->slots[n->count - 1]);
+    }
+
+    static BookNode* floorIn(const Node *n, int level, int id) {
+        if (level == 1) {
+            int i = lowerSlot(n, id);
+            if (i < n->count && n->keys[i] == id) return static_cast<BookNode*>(n->slots[i]);
+            return i == 0 ? NULL : static_cast<BookNode*>(n->slots[i - 1]);
+        }
+        int i = route(n, id);
+        // a stale separator can send us to a child holding only larger ids
+        BookNode *b = floorIn(child(n, i), level - 1, id);
+        if (b == NULL && i > 0) b = lastIn(child(n, i - 1), level - 1);
+        return b;
+    }
+
+    static void destroy(Node *n, int level) {
+        if (level > 1) {
+            for (int i = 0; i < n->count; ++i) destroy(child(n, i), level - 1);
+        }
+        delete n;
+    }
+
+public:
+    BookOrderIndex() : root(NULL), height(0), count(0) {}
+
+    ~BookOrderIndex() {
+        clear();
+    }
+
+    size_t size() const { return count; }
+
+    void clear() {
+        if (root != NULL) destroy(root, height);
+        root = NULL;
+        height = 0;
+        count = 0;
+    }
+
+    // Insert or replace the node stored for node->id
+    void insert(BookNode *node) {
+        if (root == NULL) {
+            root = new Node;
+            root->count = 0;
+            height = 1;
+        }
+        Node *right = insertInto(root, height, node->id, node);
+        if (right != NULL) {
+            Node *top = new Node;
+            top->count = 2;
+            top->keys[0] = root->keys[0];
+            top->slots[0] = root;
+            top->keys[1] = right->keys[0];
+            top->slots[1] = right;
+            root = top;
+            ++height;
+        }
+    }
+
+    bool erase(int id) {
+        if (root == NULL) return false;
+        bool emptied;
+        if (!eraseFrom(root, height, id, &emptied)) return false;
+        if (emptied) {
+            delete root;
+            root = NULL;
+            height = 0;
+        } else {
+            // a root with one child hands over to it
+            while (height > 1 && root->count == 1) {
+                Node *only = child(root, 0);
+                delete root;
+                root = only;
+                --height;
+            }
+        }
+        return true;
+    }
+
+    // Book with the largest id <= id; NULL if there is none
+    BookNode* floor(int id) const {
+        if (root == NULL) return NULL;
+        return floorIn(root, height, id);
+    }
+
+    // Rebuilds the tree from a list already sorted by id, in O(n): leaves
+    // are packed full left to right, then each level above them. Only the
+    // first node of a run of equal ids is indexed.
+    void build(BookNode *head) {
+        clear();
+        vector<Node*> level;
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            if (!level.empty()) {
+                Node *last = level.back();
+                if (last->keys[last->count - 1] == cur->id) continue;
+            }
+            if (level.empty() || level.back()->count == FANOUT) {
+                Node *leaf = new Node;
+                leaf->count = 0;
+                level.push_back(leaf);
+            }
+            Node *leaf = level.back();
+            leaf->keys[leaf->count] = cur->id;
+            leaf->slots[leaf->count] = cur;
+            ++leaf->count;
+            ++count;
+        }
+        if (level.empty()) return;
+        height = 1;
+        while (level.size() > 1) {
+            vector<Node*> up;
+            for (size_t i = 0; i < level.size(); ++i) {
+                if (up.empty() || up.back()->count == FANOUT) {
+                    Node *inner = new Node;
+                    inner->count = 0;
+                    up.push_back(inner);
+                }
+                Node *inner = up.back();
+                inner->keys[inner->count] = level[i]->keys[0];
+                inner->slots[inner->count] = level[i];
+                ++inner->count;
+            }
+            level.swap(up);
+            ++height;
+        }
+        root = level[0];
+    }
+};
+
+// ========================= WAITING QUEUE MEMBERSHIP =========================
+// Open-addressing set of (book, student) pairs that are currently queued,
+// pointing at the WaitNode. Replaces the queue walk in duplicate checks and
+// position lookups. Same probing and tombstone scheme as BookIdIndex.
+
+class WaitSet {
+    struct Slot {
+        const BookNode *book;       // NULL = empty, TOMBSTONE = deleted
+        const StudentEntry *student;
+        WaitNode *node;
+    };
+
+    vector<Slot> slots;
+    vector<Slot> spare;     // the table before the last rehash; the next one
+                            // reuses it, so a tombstone sweep does not allocate
+    size_t mask;
+    size_t count;
+    size_t used;
+
+    static const BookNode* tombstone() {
+        return reinterpret_cast<const BookNode*>(1);
+    }
+
+    size_t slotFor(const BookNode *b, const StudentEntry *s) const {
+        unsigned long long h = (unsigned long long)(size_t)b * 0x9E3779B97F4A7C15ULL;
+        h ^= (unsigned long long)(size_t)s * 0xC2B2AE3D27D4EB4FULL;
+        return (size_t)(h >> 29) & mask;
+    }
+
+    void rehash(size_t newCap) {
+        vector<Slot> &old = spare;
+        old.swap(slots);
+        Slot empty = {NULL, NULL, NULL};
+        slots.assign(newCap, empty);
+        mask = newCap - 1;
+        count = used = 0;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (old[i].book != NULL && old[i].book != tombstone()) {
+                put(old[i].book, old[i].student, old[i].node);
+            }
+        }
+    }
+
+    void put(const BookNode *b, const StudentEntry *s, WaitNode *node) {
+        size_t i = slotFor(b, s);
+        while (slots[i].book != NULL) i = (i + 1) & mask;
+        slots[i].book = b;
+        slots[i].student = s;
+        slots[i].node = node;
+        ++count;
+        ++used;
+    }
+
+    size_t locate(const BookNode *b, const StudentEntry *s) const {
+        size_t i = slotFor(b, s);
+        while (slots[i].book != NULL) {
+            if (slots[i].book == b && slots[i].student == s) return i;
+            i = (i + 1) & mask;
+        }
+        return slots.size();
+    }
+
+public:
+    WaitSet() : mask(0), count(0), used(0) {
+        rehash(16);
+    }
+
+    size_t size() const { return count; }
+
+    WaitNode* find(const BookNode *b, const StudentEntry *s) const {
+        size_t i = locate(b, s);
+        return i == slots.size() ? NULL : slots[i].node;
+    }
+
+    void insert(WaitNode *node) {
+        if (find(node->book, node->owner) != NULL) return;
+        if ((used + 1) * 10 > slots.size() * 7) {
+            bool grow = (count + 1) * 2 > slots.size();
+            rehash(grow ? slots.size() * 2 : slots.size());
+        }
+        put(node->book, node->owner, node);
+    }
+
+    void erase(const WaitNode *node) {
+        size_t i = locate(node->book, node->owner);
+        if (i == slots.size()) return;
+        slots[i].book = tombstone();
+        --count;
+    }
+};
+
+#endif // BOOK_INDEX_H
@@ -0,0 +1,152 @@
+#ifndef BOOK_VERSIONS_H
+#define BOOK_VERSIONS_H
+
+#include "Pool.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+// ========================= SNAPSHOT READS (MVCC) =========================
+// Searches and listings read a book's circulation counts (copies available,
+// students waiting) from published versions instead of the live node, so
+// they take no book lock and see the whole catalog as of one moment.
+//
+// Every issue / return publishes a new immutable BookVersion stamped with
+// the next value of a commit clock; the version it replaces stays reachable
+// through `older`. A reader pins the clock at its start and, for each book,
+// takes the newest version stamped at or before that. A replaced version is
+// freed by a later publish once no pinned reader can still need it: readers
+// only announce their snapshot, writers do all the freeing.
+
+struct BookVersion {
+    int available;
+    int waiting;
+    uint64_t commit;                // clock value it was published at
+    const BookVersion *older;       // the version it replaced
+};
+
+class VersionStore {
+    enum { READER_SLOTS = 64 };     // readers pinned at once; more wait
+    enum { RECLAIM_EVERY = 256 };   // publishes between reclaim passes
+
+    struct alignas(64) ReaderSlot {
+        atomic<uint64_t> pinned;    // lower bound of the reader's snapshot, 0 = free
+    };
+
+    struct Retired {
+        const BookVersion *version;
+        uint64_t replacedAt;        // snapshots older than this still need it
+    };
+
+    atomic<uint64_t> clock;         // last commit published
+    ReaderSlot readers[READER_SLOTS];
+    mutable mutex commitLock;       // publishing, retiring and freeing
+    NodePool<BookVersion> pool;
+    vector<Retired> retired;
+    size_t sinceReclaim;
+
+    VersionStore(const VersionStore&);
+    VersionStore& operator=(const VersionStore&);
+
+    // Commit lock held, so the clock stands still. A reader missed by the
+    // scan announced itself after it, and then read a clock at least this
+    // high, so it needs nothing freed here.
+    void reclaim() {
+        uint64_t safe = clock.load();
+        for (int i = 0; i < READER_SLOTS; ++i) {
+            uint64_t p = readers[i].pinned.load();
+            if (p != 0 && p < safe) safe = p;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].replacedAt <= safe) {
+                pool.destroy(const_cast<BookVersion*>(retired[i].version));
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+        sinceReclaim = 0;
+    }
+
+public:
+    VersionStore() : clock(1), sinceReclaim(0) {
+        for (int i = 0; i < READER_SLOTS; ++i) readers[i].pinned.store(0);
+    }
+
+    // Pins a snapshot of everything published so far; pass slot to unpin.
+    uint64_t pin(int &slot) {
+        int start = (int)(hash<thread::id>()(this_thread::get_id()) % READER_SLOTS);
+        while (true) {
+            for (int k = 0; k < READER_SLOTS; ++k) {
+                int i = (start + k) % READER_SLOTS;
+                uint64_t freeSlot = 0;
+                // announce a bound first, then read the snapshot itself
+                if (readers[i].pinned.compare_exchange_strong(freeSlot, clock.load())) {
+                    slot = i;
+                    return clock.load();
+                }
+            }
+            this_thread::yield();
+        }
+    }
+
+    void unpin(int slot) {
+        readers[slot].pinned.store(0);
+    }
+
+    // Newest version of a book stamped at or before snapshot; NULL if the
+    // book was first published after it.
+    static const BookVersion* at(const atomic<const BookVersion*> &head, uint64_t snapshot) {
+        const BookVersion *v = head.load(memory_order_acquire);
+        while (v != NULL && v->commit > snapshot) v = v->older;
+        return v;
+    }
+
+    // The caller keeps other publishers of this book out (its book lock).
+    void publish(atomic<const BookVersion*> &head, int available, int waiting) {
+        lock_guard<mutex> g(commitLock);
+        BookVersion *v = pool.create();
+        v->available = available;
+        v->waiting = waiting;
+        v->commit = clock.load() + 1;
+        v->older = head.load(memory_order_relaxed);
+        head.store(v, memory_order_release);
+        if (v->older != NULL) {
+            Retired r = {v->older, v->commit};
+            retired.push_back(r);
+        }
+        clock.store(v->commit);
+        if (++sinceReclaim >= RECLAIM_EVERY) reclaim();
+    }
+
+    // A deleted book's current version; no reader may be looking at it.
+    // Versions it replaced are already retired and go the usual way.
+    void drop(atomic<const BookVersion*> &head) {
+        const BookVersion *v = head.exchange(NULL);
+        if (v == NULL) return;
+        lock_guard<mutex> g(commitLock);
+        pool.destroy(const_cast<BookVersion*>(v));
+    }
+
+    // Frees every version at once; the caller has cleared all the heads
+    // and no reader is pinned.
+    void releaseAll() {
+        lock_guard<mutex> g(commitLock);
+        retired.clear();
+        pool.releaseAll();
+        sinceReclaim = 0;
+    }
+
+    // Versions alive: one per book plus those kept for pinned readers
+    size_t liveVersions() const {
+        lock_guard<mutex> g(commitLock);
+        return pool.statistics().live;
+    }
+};
+
+#endif // BOOK_VERSIONS_H
@@ -0,0 +1,137 @@
+#ifndef CATALOG_PARSER_H
+#define CATALOG_PARSER_H
+
+#include "Book.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <charconv>
+#include <cstring>
+using namespace std;
+
+// ========================= PARALLEL CATALOG PARSER =========================
+// Parses the text catalog (id|title|author|total|avail per line) on several
+// threads. The buffer is cut into one chunk per thread, each cut moved to
+// just after a newline, so no line is split. Every thread parses its chunk
+// into its own vector; reading the vectors in chunk order gives exactly the
+// books, in exactly the order, that one thread would have produced.
+//
+// Field values follow BookNode::parseFileLine, so the catalog loads the
+// same either way. Lines that do not look like the writer's output are
+// also reported, with their byte offset in the file.
+
+struct ParsedBook {
+    int id;
+    int total;
+    int avail;
+    string_view title;      // into the parsed buffer
+    string_view author;
+};
+
+struct MalformedLine {
+    size_t offset;          // byte offset of the line in the file
+    const char *reason;
+    bool skipped;           // true: not loaded at all (no id)
+};
+
+class CatalogParser {
+public:
+    enum { MIN_CHUNK = 1 << 20 };       // smaller files are parsed on one thread
+    enum { MAX_REPORTED = 20 };         // malformed lines kept per chunk
+
+    struct Chunk {
+        vector<ParsedBook> books;
+        vector<MalformedLine> malformed;    // first MAX_REPORTED, in file order
+        size_t malformedCount;
+    };
+
+private:
+    // The whole field is a decimal int, as the writer puts it (a trailing
+    // '\r' from a CRLF file is allowed).
+    static bool strictInt(const char *p, const char *end) {
+        if (end != p && end[-1] == '\r') --end;
+        int v;
+        from_chars_result r = from_chars(p, end, v);
+        return p != end && r.ec == errc() && r.ptr == end;
+    }
+
+    // NULL if the line is well-formed, otherwise why not
+    static const char* check(const char *p, const char *end) {
+        const char *bars[5];
+        int n = 0;
+        for (const char *q = p; q != end; ++q) {
+            if (*q != '|') continue;
+            if (n == 4) return "extra fields";
+            bars[n++] = q;
+        }
+        if (n < 4) return "missing fields";
+        if (!strictInt(p, bars[0])) return "bad id";
+        if (!strictInt(bars[2] + 1, bars[3]) || !strictInt(bars[3] + 1, end)) {
+            return "bad copy count";
+        }
+        return NULL;
+    }
+
+    static void note(Chunk &c, size_t offset, const char *reason, bool skipped) {
+        if (c.malformed.size() < MAX_REPORTED) {
+            MalformedLine m = {offset, reason, skipped};
+            c.malformed.push_back(m);
+        }
+        ++c.malformedCount;
+    }
+
+public:
+    // Lines of [p, end); base is the start of the file, for offsets.
+    static void parseChunk(const char *base, const char *p, const char *end, Chunk &out) {
+        out.books.clear();
+        out.malformed.clear();
+        out.malformedCount = 0;
+        out.books.reserve((end - p) / 48 + 1);
+        ParsedBook b;
+        while (p < end) {
+            const char *eol = (const char*)memchr(p, '\n', end - p);
+            if (eol == NULL) eol = end;
+            if (eol != p) {
+                if (BookNode::parseFileLine(p, eol, b.id, b.title, b.author,
+                                            b.total, b.avail)) {
+                    const char *why = check(p, eol);
+                    if (why != NULL) note(out, p - base, why, false);
+                    out.books.push_back(b);
+                } else {
+                    note(out, p - base, "no id", true);
+                }
+            }
+            p = eol + 1;
+        }
+    }
+
+    // Splits data into up to `threads` newline-aligned chunks (0 = one per
+    // core) and parses them in parallel; chunks come back in file order.
+    static void parse(const string &data, unsigned threads, vector<Chunk> &chunks) {
+        if (threads == 0) threads = thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+        size_t most = data.size() / MIN_CHUNK;
+        if (threads > most) threads = most > 0 ? (unsigned)most : 1;
+
+        const char *base = data.data();
+        const char *end = base + data.size();
+        vector<const char*> cuts(threads + 1, end);
+        cuts[0] = base;
+        for (unsigned i = 1; i < threads; ++i) {
+            const char *c = base + data.size() / threads * i;
+            if (c < cuts[i-1]) c = cuts[i-1];
+            const char *nl = (const char*)memchr(c, '\n', end - c);
+            cuts[i] = nl == NULL ? end : nl + 1;
+        }
+
+        chunks.assign(threads, Chunk());
+        vector<thread> workers;
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.push_back(thread(parseChunk, base, cuts[i], cuts[i+1], ref(chunks[i])));
+        }
+        parseChunk(base, cuts[0], cuts[1], chunks[0]);
+        for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+    }
+};
+
+#endif // CATALOG_PARSER_H
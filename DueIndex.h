@@ -0,0 +1,96 @@
+#ifndef DUE_INDEX_H
+#define DUE_INDEX_H
+
+#include "Book.h"
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// ========================= DUE-DATE INDEX (MIN-HEAP) =========================
+// Every active loan, ordered by due day. Each IssuedRecord remembers its heap
+// slot, so a return removes it in O(log n). Loans due before a given day are
+// found by walking the heap from the root and stopping at any node that is
+// not overdue (its whole subtree is due later), which visits O(k) nodes.
+
+class DueIndex {
+    vector<IssuedRecord*> heap;
+
+    void place(size_t i, IssuedRecord *rec) {
+        heap[i] = rec;
+        rec->heapPos = (int)i;
+    }
+
+    void siftUp(size_t i) {
+        IssuedRecord *rec = heap[i];
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (heap[parent]->dueDay <= rec->dueDay) break;
+            place(i, heap[parent]);
+            i = parent;
+        }
+        place(i, rec);
+    }
+
+    void siftDown(size_t i) {
+        IssuedRecord *rec = heap[i];
+        size_t n = heap.size();
+        while (true) {
+            size_t child = 2 * i + 1;
+            if (child >= n) break;
+            if (child + 1 < n && heap[child + 1]->dueDay < heap[child]->dueDay) ++child;
+            if (rec->dueDay <= heap[child]->dueDay) break;
+            place(i, heap[child]);
+            i = child;
+        }
+        place(i, rec);
+    }
+
+public:
+    size_t size() const { return heap.size(); }
+
+    void reserve(size_t n) {
+        heap.reserve(n);
+    }
+
+    void clear() {
+        heap.clear();
+    }
+
+    // Earliest due loan, NULL if there are none
+    IssuedRecord* earliest() const {
+        return heap.empty() ? NULL : heap[0];
+    }
+
+    void insert(IssuedRecord *rec) {
+        heap.push_back(rec);
+        siftUp(heap.size() - 1);
+    }
+
+    void erase(IssuedRecord *rec) {
+        if (rec->heapPos < 0) return;
+        size_t i = (size_t)rec->heapPos;
+        rec->heapPos = -1;
+        IssuedRecord *last = heap.back();
+        heap.pop_back();
+        if (i == heap.size()) return;
+        place(i, last);
+        if (i > 0 && heap[(i - 1) / 2]->dueDay > last->dueDay) siftUp(i);
+        else siftDown(i);
+    }
+
+    // Appends every loan with dueDay < day (in heap order, not sorted)
+    void collectDueBefore(int day, vector<IssuedRecord*> &out) const {
+        if (heap.empty() || heap[0]->dueDay >= day) return;
+        vector<size_t> stack(1, 0);
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+            out.push_back(heap[i]);
+            for (size_t c = 2 * i + 1; c <= 2 * i + 2 && c < heap.size(); ++c) {
+                if (heap[c]->dueDay < day) stack.push_back(c);
+            }
+        }
+    }
+};
+
+#endif // DUE_INDEX_H
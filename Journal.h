@@ -0,0 +1,204 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <string>
+#include <cstdio>
+#include <mutex>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+// ========================= TRANSACTION JOURNAL =========================
+// Append-only log of library mutations, one '|'-separated line per record:
+//
+//   A|id|title|author|total|avail    add book
+//   D|id                             delete book
+//   I|book|student|issue|due         issue (one copy leaves the shelf)
+//   R|book|student                   return (one copy back on the shelf)
+//   Q|book|student                   join the waiting queue
+//   X|book|issue|due                 front of the queue gets the book
+//   L|book|student|issue|due         loan carried over from the last snapshot
+//   G|generation                     first line of a journal file (see
+//                                    Library::loadFromFile); not a mutation
+//
+// Dates are written as yyyymmdd. Records are buffered and written with a
+// single write + fsync per commit, so a batch of mutations costs one sync
+// (group commit). A line without its trailing newline is a torn write and is
+// ignored on replay.
+//
+// appendShared / syncTo are the thread-safe pair: while one thread writes and
+// syncs, others keep appending, and the next sync covers all of them.
+
+class Journal {
+    string path;
+    int fd;
+    string buffer;
+    size_t written;         // leading bytes of buffer already in the file
+    size_t pending;         // records in buffer
+    size_t records;         // records in the file since it was created
+    size_t synced;          // records known to be on disk
+    mutex bufferLock;       // buffer, written, pending, records (shared use)
+    mutex syncLock;         // one writer + fsync at a time (shared use)
+    string flushing;        // what syncTo is writing; kept, with its capacity,
+                            // for the next sync (under syncLock)
+
+    // Writes data from byte done on and syncs it; done tracks progress, so
+    // a failed write is resumed, not repeated, by the next call.
+    bool writeOut(const string &data, size_t &done) {
+        while (done < data.size()) {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            done += (size_t)n;
+        }
+        int r;
+        do {
+            r = ::fsync(fd);
+        } while (r != 0 && errno == EINTR);
+        return r == 0;
+    }
+
+public:
+    explicit Journal(const string &file)
+            : path(file), fd(-1), written(0), pending(0), records(0), synced(0) {}
+
+    ~Journal() {
+        close();
+    }
+
+    const string& fileName() const { return path; }
+    bool isOpen() const { return fd >= 0; }
+    size_t size() const { return records + pending; }
+
+    // Opens for appending; existingRecords is what replay found in the file.
+    bool open(size_t existingRecords) {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        buffer.clear();
+        written = pending = 0;
+        records = synced = existingRecords;
+        return fd >= 0;
+    }
+
+    void close() {
+        if (fd < 0) return;
+        commit();
+        ::close(fd);
+        fd = -1;
+    }
+
+    void append(const string &record) {
+        if (fd < 0) return;
+        buffer += record;
+        buffer += '\n';
+        ++pending;
+    }
+
+    // Writes everything buffered since the last commit and syncs it. On
+    // failure the records stay buffered and the next commit carries on
+    // from the last byte written.
+    bool commit() {
+        if (fd < 0 || pending == 0) return true;
+        if (!writeOut(buffer, written)) return false;
+        records += pending;
+        synced = records;
+        pending = 0;
+        buffer.clear();
+        written = 0;
+        return true;
+    }
+
+    // Thread-safe append; returns the record's sequence number for syncTo.
+    size_t appendShared(const string &record) {
+        lock_guard<mutex> g(bufferLock);
+        append(record);
+        return records + pending;
+    }
+
+    // Returns once record seq is on disk. The thread that gets the sync lock
+    // takes everything buffered so far, so waiting callers share its fsync.
+    // If the write fails, the records go back in front of the buffer (with
+    // the bytes already written noted) for the next sync to finish.
+    bool syncTo(size_t seq) {
+        lock_guard<mutex> s(syncLock);
+        if (fd < 0 || seq <= synced) return true;
+        string &out = flushing;
+        out.clear();
+        size_t taken, done;
+        {
+            lock_guard<mutex> g(bufferLock);
+            out.swap(buffer);
+            done = written;
+            written = 0;
+            taken = pending;
+            records += pending;
+            pending = 0;
+        }
+        if (writeOut(out, done)) {
+            synced += taken;
+            return true;
+        }
+        lock_guard<mutex> g(bufferLock);
+        buffer.insert(0, out);
+        written = done;
+        records -= taken;
+        pending += taken;
+        return false;
+    }
+
+    // ---------- record builders ----------
+    // Mutation records are formatted into out, replacing what it held, so a
+    // caller can keep one buffer and not allocate per record.
+    static void appendField(string &out, int v) {
+        char buf[16];
+        out.append(buf, snprintf(buf, sizeof(buf), "|%d", v));
+    }
+
+    static void addRecord(string &out, int id, const string &title, const string &author,
+                          int total, int avail) {
+        out.assign("A");
+        appendField(out, id);
+        out += '|';
+        out += title;
+        out += '|';
+        out += author;
+        appendField(out, total);
+        appendField(out, avail);
+    }
+
+    static void deleteRecord(string &out, int id) {
+        out.assign("D");
+        appendField(out, id);
+    }
+
+    static void issueRecord(string &out, char type, int bookId, const string &studentId,
+                            int issue, int due) {
+        studentRecord(out, type, bookId, studentId);
+        appendField(out, issue);
+        appendField(out, due);
+    }
+
+    static void studentRecord(string &out, char type, int bookId, const string &studentId) {
+        out.assign(1, type);
+        appendField(out, bookId);
+        out += '|';
+        out += studentId;
+    }
+
+    static void autoIssueRecord(string &out, int bookId, int issue, int due) {
+        out.assign("X");
+        appendField(out, bookId);
+        appendField(out, issue);
+        appendField(out, due);
+    }
+
+    static string generationRecord(uint64_t generation) {
+        return "G|" + to_string(generation);
+    }
+};
+
+#endif // JOURNAL_H
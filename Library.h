@@ -2,334 +2,1496 @@
 #define LIBRARY_H
 
 #include "Book.h"
+#include "BookIndex.h"
+#include "SearchIndex.h"
+#include "PrefixIndex.h"
+#include "Pool.h"
+#include "Journal.h"
+#include "Snapshot.h"
+#include "DueIndex.h"
+#include "CatalogParser.h"
+#include "Metrics.h"
+#include "BackgroundSaver.h"
 #include <fstream>
-#include <limits>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <memory>
 using namespace std;
 
+// ========================= OPERATION RESULTS =========================
+// The Library core never reads or prints; each operation reports what
+// happened and the menus in Main.cpp turn that into messages.
+
+enum LibStatus {
+    LIB_OK,
+    LIB_QUEUED,             // no copy free, student joined the waiting queue
+    LIB_NOT_FOUND,          // no book with that id
+    LIB_DUPLICATE_ID,
+    LIB_INVALID_COPIES,
+    LIB_INVALID_DATE,
+    LIB_ALREADY_ISSUED,
+    LIB_ALREADY_QUEUED,
+    LIB_NOT_ISSUED          // the student does not hold that book
+};
+
+struct IssueResult {
+    LibStatus status;
+    Date dueDate;           // LIB_OK
+    int queuePosition;      // LIB_QUEUED, LIB_ALREADY_QUEUED
+};
+
+struct ReturnResult {
+    LibStatus status;
+    Date dueDate;           // of the returned loan
+    int daysLate;           // 0 if returned on time
+    int fine;
+    string nextStudent;     // front of the queue, now holding the book ("" if none)
+    Date nextDueDate;
+};
+
+struct LoadResult {
+    bool found;             // a snapshot or books.txt was there
+    int duplicates;         // duplicate ids dropped from books.txt
+    bool journalOpen;       // false: changes will not be saved
+    size_t malformed;       // books.txt lines not in the writer's format
+    vector<MalformedLine> malformedLines;   // the first few, in file order
+};
+
+struct FuzzyMatch {
+    BookNode *book;
+    double score;           // similarity, 0..1
+};
+
+struct Completion {
+    BookNode *book;         // lowest id with this title / author
+    int books;              // books sharing it
+};
+
+struct SearchIndexMemory {
+    size_t substring;
+    size_t fuzzy;
+    size_t prefix;
+    size_t prefixKeys;      // distinct titles + distinct authors
+    size_t prefixNodes;
+};
+
+enum ExportFormat {
+    EXPORT_TSV,
+    EXPORT_JSONL            // one JSON object per line
+};
+
 class Library {
     BookNode *head;
+    BookIdIndex idIndex;
+    BookOrderIndex orderIndex;
+    // Substring and typo-tolerant indexes: built by
+    // prepareSearchInBackground (or else on the first search that needs
+    // them), then kept up to date by adds and deletes
+    mutable SubstringIndex titleIndex;
+    mutable SubstringIndex authorIndex;
+    mutable bool textIndexed;
+    mutable FuzzyIndex fuzzyTitleIndex;
+    mutable FuzzyIndex fuzzyAuthorIndex;
+    mutable bool fuzzyIndexed;
+    // While the builder thread owns the indexes it was started for (the
+    // *Pending ones), adds and deletes queue up here and are applied once
+    // it is joined
+    struct IndexChange {
+        bool added;
+        int id;
+        StrRef title;
+        StrRef author;
+    };
+    mutable thread indexBuilder;
+    mutable bool textPending;
+    mutable bool fuzzyPending;
+    mutable vector<IndexChange> indexBacklog;
+    // Built on the first autocomplete
+    mutable PrefixIndex titlePrefix;
+    mutable PrefixIndex authorPrefix;
+    mutable bool prefixIndexed;
+    StringPool strings;             // titles and authors, deduplicated
+    NodePool<BookNode> bookPool;
+    NodePool<WaitNode> waitPool;
+    NodePool<IssuedRecord> issuedPool;
+    StudentRegistry registry;
+    StudentTable students;
+    WaitSet queued;
+    DueIndex dueIndex;
     string dbFile;
+    string snapFile;
+    Journal journal;
+    // The last journal write failed: changes since are only in memory until
+    // a later commit (which retries them) or a snapshot succeeds
+    atomic<bool> journalFailed;
+    int batchDepth;
+    size_t batchSeq;        // last journal record of the open batch (concurrent mode)
     int loanDays;
     int finePerDay;
+    // Set by setConcurrent: the state every book shares (pools, student
+    // entries, queue set, due index) is then only touched under stateMutex,
+    // and the journal is group-committed across threads.
+    bool concurrent;
+    mutable mutex stateMutex;
+    // Published book counts for ReadSnapshot (concurrent mode only)
+    mutable VersionStore versions;
+    // Writes compactions in the background; declared after everything its
+    // jobs read, so its thread is gone before they are
+    BackgroundSaver saver;
+    unsigned loadThreads;   // parser threads for books.txt, 0 = one per core
+    uint64_t journalGen;    // generation of the open journal
+    // The journal before the last background compaction, kept as
+    // *.journal.prev until that compaction commits
+    bool prevJournalPending;
+#if LMS_METRICS
+    // queueLengths[n] = books with n students waiting (n >= 1); the last
+    // entry is never 0, so the longest queue is size() - 1.
+    vector<size_t> queueLengths;
 
-public:
-    Library(const string &file = "books.txt")
-            : head(NULL), dbFile(file), loanDays(14), finePerDay(1000) {}
+    void queueLengthChanged(int from, int to) {
+        if (from > 0) --queueLengths[from];
+        if (to > 0) {
+            if ((size_t)to >= queueLengths.size()) queueLengths.resize(to + 1, 0);
+            ++queueLengths[to];
+        }
+        while (queueLengths.size() > 1 && queueLengths.back() == 0) queueLengths.pop_back();
+    }
 
-    ~Library() {
-        freeBookList(head);
+    // Times an operation and counts it as failed if its status ends up
+    // anything but OK / QUEUED.
+    class StatusTimer {
+        MetricTimer timer;
+        MetricOp op;
+        const LibStatus &status;
+        StatusTimer(const StatusTimer&);
+        StatusTimer& operator=(const StatusTimer&);
+    public:
+        StatusTimer(MetricOp o, const LibStatus &s) : timer(o), op(o), status(s) {}
+        ~StatusTimer() {
+            if (status != LIB_OK && status != LIB_QUEUED) Metrics::global().fail(op);
+        }
+    };
+#define LMS_TIME_STATUS(op, status) StatusTimer lmsStatusTimer_(op, status)
+#else
+#define LMS_TIME_STATUS(op, status) do {} while (0)
+#endif
+
+    // ---------- compaction image ----------
+    // The library as of one moment, cheap to take: plain copies of the
+    // fields, with text shared from the (append-only) string pool and names
+    // from the registry, so the saver thread never touches a live node.
+    struct FrozenLoan {
+        StudentId student;
+        int issueDay;
+        int dueDay;
+    };
+
+    struct FrozenBook {
+        int id;
+        StrRef title;
+        StrRef author;
+        int total;
+        int avail;
+        uint32_t loans;             // the next ones in FrozenCatalog::loans
+        uint32_t waits;
+    };
+
+    struct FrozenCatalog {
+        vector<FrozenBook> books;   // id order
+        vector<FrozenLoan> loans;   // grouped by book, oldest first
+        vector<StudentId> waits;    // grouped by book, front first
+        uint64_t generation;        // journal that follows this image
+    };
+
+    // Returns a node that is already unlinked, with its queue and loans,
+    // to the pools.
+    void freeBook(BookNode *node) {
+        while (node->waitFront != NULL) waitPool.destroy(dequeueStudent(node));
+        while (node->issuedHead != NULL) {
+            issuedPool.destroy(takeBack(node, node->issuedHead->student));
+        }
+        versions.drop(node->version);
+        bookPool.destroy(node);
     }
 
-    // ---------- FILE I/O ----------
-    void loadFromFile() {
-        ifstream fin(dbFile.c_str());
-        if (!fin) {
-            cout << "No existing book database found, starting empty.\n";
-            return;
+    // Loan / queue nodes already tied to the student's entry; linking them
+    // into a book (addIssued / enqueueWait) links them into the entry too.
+    IssuedRecord* newLoan(StudentId student, int issue, int due) {
+        IssuedRecord *rec = issuedPool.create(student, issue, due);
+        rec->owner = &students.at(student);
+        return rec;
+    }
+
+    WaitNode* newWait(StudentId student) {
+        WaitNode *wn = waitPool.create(student);
+        wn->owner = &students.at(student);
+        return wn;
+    }
+
+    // issue / due are day numbers
+    void lendTo(BookNode *b, StudentId student, int issue, int due) {
+        IssuedRecord *rec = newLoan(student, issue, due);
+        b->addIssued(rec);
+        dueIndex.insert(rec);
+    }
+
+    // The student's loan of this book, unlinked (caller frees it); NULL if none
+    IssuedRecord* takeBack(BookNode *b, StudentId student) {
+        IssuedRecord *rec = NULL;
+        if (!b->removeIssued(student, rec)) return NULL;
+        dueIndex.erase(rec);
+        return rec;
+    }
+
+    // After an issue / return, under the book's lock
+    void publishCounts(BookNode *b) {
+        if (concurrent) versions.publish(b->version, b->availableCopies, b->waitCount);
+    }
+
+    void enqueueStudent(BookNode *b, StudentId student) {
+        WaitNode *wn = newWait(student);
+        b->enqueueWait(wn);
+        queued.insert(wn);
+#if LMS_METRICS
+        queueLengthChanged(b->waitCount - 1, b->waitCount);
+#endif
+    }
+
+    // Front of the book's queue, unlinked (caller frees it); NULL if empty
+    WaitNode* dequeueStudent(BookNode *b) {
+        WaitNode *wn = b->dequeueWait();
+        if (wn != NULL) {
+            queued.erase(wn);
+#if LMS_METRICS
+            queueLengthChanged(b->waitCount + 1, b->waitCount);
+#endif
         }
-        string line;
-        while (getline(fin, line)) {
-            if (line.empty()) continue;
-            BookNode *node = BookNode::fromFileLine(line);
-            if (node) insertSorted(node);
+        return wn;
+    }
+
+    // ordered = false leaves the B+tree to a later build (bulk insert)
+    void index(BookNode *node, bool ordered = true) {
+        idIndex.insert(node);
+        if (ordered) orderIndex.insert(node);
+        if (textIndexed) {
+            titleIndex.add(node->id, node->title);
+            authorIndex.add(node->id, node->author);
+        }
+        if (fuzzyIndexed) {
+            fuzzyTitleIndex.add(node->id, node->title);
+            fuzzyAuthorIndex.add(node->id, node->author);
+        }
+        if (indexBuilder.joinable()) {
+            IndexChange c = {true, node->id, node->title, node->author};
+            indexBacklog.push_back(c);
+        }
+        if (prefixIndexed) {
+            titlePrefix.add(node->id, node->title);
+            authorPrefix.add(node->id, node->author);
         }
-        fin.close();
     }
 
-    void saveToFile() {
-        ofstream fout(dbFile.c_str());
-        BookNode *cur = head;
-        while (cur != NULL) {
-            fout << cur->toFileLine() << "\n";
-            cur = cur->next;
+    // Drop an unlinked node from the indexes. Ids are unique in the list
+    // (addBook, replay and bulkInsert all refuse duplicates).
+    void unindex(BookNode *node) {
+        if (textIndexed) {
+            titleIndex.remove(node->id, node->title);
+            authorIndex.remove(node->id, node->author);
         }
-        fout.close();
+        if (fuzzyIndexed) {
+            fuzzyTitleIndex.remove(node->id, node->title);
+            fuzzyAuthorIndex.remove(node->id, node->author);
+        }
+        if (indexBuilder.joinable()) {
+            IndexChange c = {false, node->id, node->title, node->author};
+            indexBacklog.push_back(c);
+        }
+        if (prefixIndexed) {
+            titlePrefix.remove(node->id, node->title);
+            authorPrefix.remove(node->id, node->author);
+        }
+        idIndex.erase(node->id);
+        orderIndex.erase(node->id);
     }
 
-    // ---------- BASIC LIST OPS ----------
-    BookNode* findById(int id) const {
-        BookNode *cur = head;
-        while (cur != NULL) {
-            if (cur->id == id) return cur;
-            cur = cur->next;
+    static bool readWholeFile(const string &path, string &data) {
+        ifstream fin(path.c_str(), ios::binary);
+        if (!fin) return false;
+        fin.seekg(0, ios::end);
+        streamoff len = fin.tellg();
+        fin.seekg(0, ios::beg);
+        data.clear();
+        if (len > 0) {
+            data.resize((size_t)len);
+            fin.read(&data[0], len);
+            data.resize((size_t)fin.gcount());
         }
-        return NULL;
+        return true;
     }
 
-    bool existsId(int id) const {
-        return findById(id) != NULL;
+    static bool fileExists(const string &path) {
+        ifstream fin(path.c_str());
+        return fin.good();
     }
 
-    void insertSorted(BookNode *node) {
-        if (head == NULL || node->id < head->id) {
-            node->next = head;
-            head = node;
+    // Journal records are formatted here, one buffer per thread, so a
+    // mutation does not allocate for its record
+    static string& recordBuffer() {
+        static thread_local string buf;
+        return buf;
+    }
+
+    // Journal mutation; synced right away unless a batch is open.
+    void logRecord(const string &rec) {
+        if (concurrent) {
+            size_t seq = journal.appendShared(rec);
+            if (batchDepth > 0) batchSeq = seq;
+            else noteJournalWrite(journal.syncTo(seq));
             return;
         }
-        BookNode *cur = head;
-        while (cur->next != NULL && cur->next->id < node->id) {
-            cur = cur->next;
+        journal.append(rec);
+        if (batchDepth == 0) noteJournalWrite(journal.commit());
+    }
+
+    void noteJournalWrite(bool ok) {
+        if (!ok) LMS_FAIL(OP_SAVE);
+        journalFailed.store(!ok);
+    }
+
+    // Every file is replaced by writing *.tmp and renaming it, so a *.tmp
+    // left behind was never finished.
+    void removeTempFiles() {
+        remove((snapFile + ".tmp").c_str());
+        remove((journal.fileName() + ".tmp").c_str());
+        remove((dbFile + ".tmp").c_str());
+    }
+
+    string prevJournalFile() const {
+        return journal.fileName() + ".prev";
+    }
+
+    // Reads a journal file and its generation (0 for a journal written
+    // before generations, which has no G line). False if there is none.
+    static bool readJournal(const string &path, string &data, uint64_t &generation) {
+        if (!readWholeFile(path, data)) return false;
+        generation = 0;
+        if (data.size() > 2 && data[0] == 'G' && data[1] == '|') {
+            generation = strtoull(data.c_str() + 2, NULL, 10);
         }
-        node->next = cur->next;
-        cur->next = node;
+        return true;
     }
 
-    void deleteBookById(int id) {
-        if (head == NULL) return;
-        if (head->id == id) {
-            BookNode *tmp = head;
-            head = head->next;
-            tmp->next = NULL;
-            freeBookList(tmp);
-            cout << "Book deleted.\n";
+    // Replaces the journal with an empty one of this generation.
+    bool startJournal(uint64_t generation) {
+        journal.close();
+        if (!replaceFileAtomically(journal.fileName(),
+                                   Journal::generationRecord(generation) + "\n")) {
+            return false;
+        }
+        journalGen = generation;
+        return journal.open(0);
+    }
+
+    void freeze(FrozenCatalog &img) const {
+        img.books.reserve(idIndex.size());
+        vector<IssuedRecord*> recs;
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            FrozenBook fb = {cur->id, cur->title, cur->author, cur->totalCopies,
+                             cur->availableCopies, 0, 0};
+            // oldest loan first, so loading rebuilds the same chain order
+            recs.clear();
+            for (IssuedRecord *ir = cur->issuedHead; ir != NULL; ir = ir->next) {
+                recs.push_back(ir);
+            }
+            for (size_t i = recs.size(); i > 0; --i) {
+                FrozenLoan l = {recs[i-1]->student, recs[i-1]->issueDay, recs[i-1]->dueDay};
+                img.loans.push_back(l);
+                ++fb.loans;
+            }
+            for (WaitNode *wn = cur->waitFront; wn != NULL; wn = wn->next) {
+                img.waits.push_back(wn->student);
+                ++fb.waits;
+            }
+            img.books.push_back(fb);
+        }
+    }
+
+    // Writes an image as the new snapshot (*.tmp, fsync, rename: the
+    // rename is the commit point), then books.txt the same way. Also runs
+    // on the saver thread, so it reads only img, file names and the registry.
+    bool writeFrozen(const FrozenCatalog &img) const {
+        LMS_TIME(OP_SNAPSHOT);
+        SnapshotBuilder sb;
+        sb.reserve(img.books.size());
+        size_t loan = 0, wait = 0;
+        for (size_t i = 0; i < img.books.size(); ++i) {
+            const FrozenBook &b = img.books[i];
+            sb.addBook(b.id, b.title, b.author, b.total, b.avail);
+            for (uint32_t k = 0; k < b.loans; ++k, ++loan) {
+                const FrozenLoan &l = img.loans[loan];
+                sb.addLoan(registry.nameOf(l.student), dayToKey(l.issueDay), dayToKey(l.dueDay));
+            }
+            for (uint32_t k = 0; k < b.waits; ++k, ++wait) {
+                sb.addWait(registry.nameOf(img.waits[wait]));
+            }
+        }
+        string snapTmp = snapFile + ".tmp";
+        if (!sb.writeTo(snapTmp, img.generation) ||
+            rename(snapTmp.c_str(), snapFile.c_str()) != 0) {
+            remove(snapTmp.c_str());
+            LMS_FAIL(OP_SNAPSHOT);
+            return false;
+        }
+        syncDirectoryOf(snapFile);
+        writeTextCopy(img);
+        return true;
+    }
+
+    // Sets the journal aside as *.journal.prev, starts the next generation
+    // and hands a frozen image to the saver thread. The caller waits for the
+    // copy, which is O(n) (about 50 ms at 1M books), and two small file
+    // operations.
+    bool compactInBackground() {
+        shared_ptr<FrozenCatalog> img(new FrozenCatalog);
+        freeze(*img);
+        img->generation = journalGen + 1;
+        journal.close();
+        if (rename(journal.fileName().c_str(), prevJournalFile().c_str()) != 0) {
+            journal.open(journal.size());
+            return writeSnapshot();
+        }
+        if (!startJournal(img->generation)) {
+            rename(prevJournalFile().c_str(), journal.fileName().c_str());
+            journal.open(journal.size());
+            return false;
+        }
+        prevJournalPending = true;
+        saver.trySubmit([this, img] {
+            if (!writeFrozen(*img)) return false;
+            remove(prevJournalFile().c_str());
+            return true;
+        });
+        return true;
+    }
+
+    // Builds the list from a mapped snapshot: fixed-size records, strings
+    // taken straight from the heap, loans and queues attached per book.
+    // Every book becomes an owned node here (the list, indexes and pools
+    // need them), so startup is still linear in the catalog; the snapshot
+    // only saves the text parsing. The mapping is closed afterwards.
+    void loadSnapshot(const SnapshotView &snap) {
+        vector<BookNode*> nodes;
+        nodes.reserve(snap.bookCount());
+        for (size_t i = 0; i < snap.bookCount(); ++i) {
+            const SnapBook &sb = snap.book(i);
+            string_view title = snap.str(sb.title);
+            string_view author = snap.str(sb.author);
+            BookNode *b = newBook(sb.id, title, author, sb.totalCopies, sb.availableCopies);
+            for (uint32_t k = 0; k < sb.loanCount && sb.firstLoan + k < snap.loanCount(); ++k) {
+                const SnapLoan &l = snap.loan(sb.firstLoan + k);
+                lendTo(b, registry.idOf(string(snap.str(l.studentId))),
+                       keyToDay(l.issueDate), keyToDay(l.dueDate));
+            }
+            for (uint32_t k = 0; k < sb.waitCount && sb.firstWait + k < snap.waitCount(); ++k) {
+                const SnapWait &w = snap.wait(sb.firstWait + k);
+                enqueueStudent(b, registry.idOf(string(snap.str(w.studentId))));
+            }
+            nodes.push_back(b);
+        }
+        bulkInsert(nodes);
+    }
+
+    // books.txt is kept as a readable copy of the catalog next to the
+    // snapshot, replaced whole (temp file, fsync, rename).
+    void writeTextCopy(const FrozenCatalog &img) const {
+        string tmp = dbFile + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "w");
+        if (f == NULL) return;
+        string buf;
+        bool ok = true;
+        for (size_t i = 0; i < img.books.size() && ok; ++i) {
+            const FrozenBook &b = img.books[i];
+            BookNode::appendFileLine(buf, b.id, b.title, b.author, b.total, b.avail);
+            buf += '\n';
+            if (buf.size() >= (1 << 16)) {
+                ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+                buf.clear();
+            }
+        }
+        if (ok && !buf.empty()) ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+        ok = (fflush(f) == 0) && ok;
+        if (ok) ok = ::fsync(fileno(f)) == 0;
+        ok = (fclose(f) == 0) && ok;
+        if (ok && rename(tmp.c_str(), dbFile.c_str()) == 0) syncDirectoryOf(dbFile);
+        else remove(tmp.c_str());
+    }
+
+    // Applies every complete mutation line of a journal file's contents.
+    size_t replayJournal(const string &data) {
+        size_t count = 0;
+        const char *p = data.data();
+        const char *end = p + data.size();
+        while (p < end) {
+            const char *eol = (const char*)memchr(p, '\n', end - p);
+            if (eol == NULL) break;     // torn last write
+            if (eol - p > 2 && p[1] == '|' && p[0] != 'G') {
+                replayRecord(p[0], p + 2, eol);
+                ++count;
+            }
+            p = eol + 1;
+        }
+        return count;
+    }
+
+    void replayRecord(char type, const char *p, const char *end) {
+        const char *f[5][2];
+        int n = 0;
+        while (n < 5) {
+            const char *bar = p;
+            while (bar != end && *bar != '|') ++bar;
+            f[n][0] = p;
+            f[n][1] = bar;
+            ++n;
+            if (bar == end) break;
+            p = bar + 1;
+        }
+        for (int i = n; i < 5; ++i) f[i][0] = f[i][1] = end;
+
+        if (type == 'A') {
+            int id, total, avail;
+            string_view title, author;
+            if (BookNode::parseFileLine(f[0][0], end, id, title, author, total, avail) &&
+                !existsId(id)) {
+                insertSorted(newBook(id, title, author, total, avail));
+            }
             return;
         }
-        BookNode *cur = head;
-        BookNode *prev = NULL;
-        while (cur != NULL && cur->id != id) {
-            prev = cur;
-            cur = cur->next;
+        int id = BookNode::parseInt(f[0][0], f[0][1]);
+        if (type == 'D') {
+            removeBook(id);
+            return;
         }
-        if (cur == NULL) {
-            cout << "Book not found.\n";
+        BookNode *b = findById(id);
+        if (b == NULL) return;
+        if (type == 'X') {
+            WaitNode *wn = dequeueStudent(b);
+            if (wn == NULL) return;
+            lendTo(b, wn->student,
+                   keyToDay(BookNode::parseInt(f[1][0], f[1][1])),
+                   keyToDay(BookNode::parseInt(f[2][0], f[2][1])));
+            waitPool.destroy(wn);
+            b->availableCopies--;
             return;
         }
-        prev->next = cur->next;
-        cur->next = NULL;
-        freeBookList(cur);
-        cout << "Book deleted.\n";
+        StudentId student = registry.idOf(string(f[1][0], f[1][1]));
+        if (type == 'I' || type == 'L') {
+            lendTo(b, student,
+                   keyToDay(BookNode::parseInt(f[2][0], f[2][1])),
+                   keyToDay(BookNode::parseInt(f[3][0], f[3][1])));
+            if (type == 'I') b->availableCopies--;
+        } else if (type == 'R') {
+            IssuedRecord *rec = takeBack(b, student);
+            if (rec != NULL) {
+                issuedPool.destroy(rec);
+                b->availableCopies++;
+            }
+        } else if (type == 'Q') {
+            enqueueStudent(b, student);
+        }
     }
 
-    // ---------- CORE FEATURES ----------
-    void addBookInteractive() {
-        int id, total;
-        string title, author;
+    // Waits for the background build, then replays the adds and deletes
+    // it missed on the indexes it built.
+    void finishIndexBuilder() const {
+        if (!indexBuilder.joinable()) return;
+        indexBuilder.join();
+        for (size_t i = 0; i < indexBacklog.size(); ++i) {
+            const IndexChange &c = indexBacklog[i];
+            if (c.added) {
+                if (textPending) {
+                    titleIndex.add(c.id, c.title);
+                    authorIndex.add(c.id, c.author);
+                }
+                if (fuzzyPending) {
+                    fuzzyTitleIndex.add(c.id, c.title);
+                    fuzzyAuthorIndex.add(c.id, c.author);
+                }
+            } else {
+                if (textPending) {
+                    titleIndex.remove(c.id, c.title);
+                    authorIndex.remove(c.id, c.author);
+                }
+                if (fuzzyPending) {
+                    fuzzyTitleIndex.remove(c.id, c.title);
+                    fuzzyAuthorIndex.remove(c.id, c.author);
+                }
+            }
+        }
+        vector<IndexChange>().swap(indexBacklog);
+        if (textPending) textIndexed = true;
+        if (fuzzyPending) fuzzyIndexed = true;
+        textPending = fuzzyPending = false;
+    }
 
-        cout << "Enter Book ID (integer): ";
-        cin >> id;
-        if (cin.fail()) {
-            cin.clear();
-            cin.ignore(10000, '\n');
-            cout << "Invalid ID.\n";
+    void buildTextIndex() const {
+        if (textIndexed) return;
+        if (textPending) {
+            finishIndexBuilder();
             return;
         }
-        if (existsId(id)) {
-            cout << "Book with this ID already exists.\n";
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            titleIndex.add(cur->id, cur->title);
+            authorIndex.add(cur->id, cur->author);
+        }
+        textIndexed = true;
+    }
+
+    void buildFuzzyIndex() const {
+        if (fuzzyIndexed) return;
+        if (fuzzyPending) {
+            finishIndexBuilder();
             return;
         }
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            fuzzyTitleIndex.add(cur->id, cur->title);
+            fuzzyAuthorIndex.add(cur->id, cur->author);
+        }
+        fuzzyIndexed = true;
+    }
 
-        cout << "Enter title: ";
-        getline(cin, title);
-        cout << "Enter author: ";
-        getline(cin, author);
+    // Builder thread: books is a copy of the list, and the pooled text
+    // never moves, so nothing the caller goes on changing is read. Only
+    // the indexes it was started for (non-NULL) are touched.
+    static void fillSearchIndexes(vector<IndexChange> books,
+                                  SubstringIndex *titles, SubstringIndex *authors,
+                                  FuzzyIndex *fuzzyTitles, FuzzyIndex *fuzzyAuthors) {
+        for (size_t i = 0; i < books.size(); ++i) {
+            if (titles != NULL) {
+                titles->add(books[i].id, books[i].title);
+                authors->add(books[i].id, books[i].author);
+            }
+            if (fuzzyTitles != NULL) {
+                fuzzyTitles->add(books[i].id, books[i].title);
+                fuzzyAuthors->add(books[i].id, books[i].author);
+            }
+        }
+    }
 
-        cout << "Total copies: ";
-        cin >> total;
-        if (total <= 0) {
-            cout << "Total copies must be positive.\n";
-            return;
+    void buildPrefixIndex() const {
+        if (prefixIndexed) return;
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            titlePrefix.add(cur->id, cur->title);
+            authorPrefix.add(cur->id, cur->author);
         }
-        int available = total;
+        prefixIndexed = true;
+    }
 
-        BookNode *node = new BookNode(id, title, author, total, available);
-        insertSorted(node);
-        cout << "Book added successfully.\n";
+    vector<Completion> completeFrom(const PrefixIndex &idx, const string &prefix, size_t n) const {
+        buildPrefixIndex();
+        vector<PrefixMatch> keys;
+        idx.complete(prefix, n, keys);
+        vector<Completion> result;
+        result.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            Completion c;
+            c.book = findById(keys[i].id);
+            c.books = keys[i].books;
+            if (c.book != NULL) result.push_back(c);
+        }
+        return result;
     }
 
-    void searchMenu() const {
-        if (head == NULL) {
-            cout << "No books in library.\n";
-            return;
+    vector<FuzzyMatch> matchFuzzy(const FuzzyIndex &idx, const string &q, size_t k) const {
+        buildFuzzyIndex();
+        vector<FuzzyHit> hits = idx.search(q, k);
+        vector<FuzzyMatch> result;
+        result.reserve(hits.size());
+        for (size_t i = 0; i < hits.size(); ++i) {
+            FuzzyMatch m;
+            m.book = findById(hits[i].id);
+            m.score = hits[i].score;
+            if (m.book != NULL) result.push_back(m);
         }
-        int choice;
-        cout << "\nSearch by:\n";
-        cout << "1. Book ID\n";
-        cout << "2. Title\n";
-        cout << "3. Author\n";
-        cout << "Choice: ";
-        cin >> choice;
-
-        if (choice == 1) {
-            int id;
-            cout << "Enter ID: ";
-            cin >> id;
-            BookNode *b = findById(id);
-            if (b == NULL) cout << "Book not found.\n";
-            else printBookDetails(b);
-        } else if (choice == 2) {
-            string q;
-            cout << "Enter title keyword: ";
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            getline(cin, q);
-            searchByTitle(q);
-        } else if (choice == 3) {
-            string q;
-            cout << "Enter author keyword: ";
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            getline(cin, q);
-            searchByAuthor(q);
-        } else {
-            cout << "Invalid choice.\n";
+        return result;
+    }
+
+    // Books whose field contains q, in id order (same as a list walk with
+    // string::find, but only the index candidates are looked at; queries
+    // under 3 bytes are that walk).
+    vector<BookNode*> matchText(const SubstringIndex &idx,
+                                StrRef BookNode::*field,
+                                const string &q) const {
+        vector<BookNode*> result;
+        if (!SubstringIndex::indexable(q)) {
+            // one or two bytes match too much of the catalog to index
+            for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+                if ((cur->*field).view().find(q) != string_view::npos) result.push_back(cur);
+            }
+            return result;
         }
+        buildTextIndex();
+        vector<int> ids;
+        bool exact = idx.candidates(q, ids);
+        for (size_t i = 0; i < ids.size(); ++i) {
+            BookNode *b = findById(ids[i]);
+            if (b == NULL) continue;
+            if (exact || (b->*field).view().find(q) != string_view::npos) {
+                result.push_back(b);
+            }
+        }
+        return result;
     }
 
-    void searchByTitle(const string &q) const {
-        BookNode *cur = head;
-        bool found = false;
-        while (cur != NULL) {
-            if (cur->title.find(q) != string::npos) {
-                printBookDetails(cur);
-                found = true;
+public:
+    Library(const string &file = "books.txt")
+            : head(NULL), textIndexed(false), fuzzyIndexed(false),
+              textPending(false), fuzzyPending(false), prefixIndexed(false), dbFile(file), snapFile(file + ".snap"),
+              journal(file + ".journal"), journalFailed(false),
+              batchDepth(0), batchSeq(0), loanDays(14), finePerDay(1000), concurrent(false),
+              loadThreads(0), journalGen(0), prevJournalPending(false) {}
+
+    // Nodes are not walked one by one: each pool drops its slabs whole. A
+    // background compaction is let finish first.
+    ~Library() {
+        if (indexBuilder.joinable()) indexBuilder.join();
+        saver.wait();
+        journal.close();
+        head = NULL;
+        issuedPool.releaseAll();
+        waitPool.releaseAll();
+        bookPool.releaseAll();
+    }
+
+    // Title and author are interned: a repeated author is stored once.
+    BookNode* newBook(int id, string_view title, string_view author,
+                      int total, int avail) {
+        return bookPool.create(id, strings.intern(title), strings.intern(author), total, avail);
+    }
+
+    const StringPool& stringPool() const { return strings; }
+
+    // Threads used to parse books.txt (0 = one per core); the catalog comes
+    // out the same for any count.
+    void setLoadThreads(unsigned n) {
+        loadThreads = n;
+    }
+
+    const PoolStats& bookPoolStats() const { return bookPool.statistics(); }
+    const PoolStats& waitPoolStats() const { return waitPool.statistics(); }
+    const PoolStats& issuedPoolStats() const { return issuedPool.statistics(); }
+
+    // ---------- FILE I/O ----------
+    // Startup: the binary snapshot (books.txt.snap) if there is one, else the
+    // text catalog books.txt; then the journal is replayed on top of it.
+    // Journals carry a generation and the snapshot names the first one it
+    // does not hold, so a journal that was set aside for a compaction which
+    // never committed (*.journal.prev) is replayed, and one already folded
+    // in is not. Two live journals are merged into a new snapshot right away.
+    // Text bulk load: read the whole file, parse it in parallel chunks
+    // (CatalogParser), sort once (books.txt is normally already in id order,
+    // so this is just a check), drop duplicate ids and link the list in a
+    // single pass.
+    LoadResult loadFromFile() {
+        return load(false);
+    }
+
+    // The same catalog, loans and queues as loadFromFile, for a reader such
+    // as an export that may run next to a live library: nothing on disk is
+    // touched (no temp-file cleanup, no journal opened, rotated or merged),
+    // and changes made to this Library are not saved.
+    LoadResult loadReadOnly() {
+        return load(true);
+    }
+
+private:
+    LoadResult load(bool readOnly) {
+        LMS_TIME(OP_LOAD);
+        LoadResult r;
+        r.found = true;
+        r.duplicates = 0;
+        r.journalOpen = false;
+        r.malformed = 0;
+        if (!readOnly) removeTempFiles();
+        SnapshotView snap;
+        string data;
+        uint64_t snapGen = 0;
+        if (snap.open(snapFile)) {
+            loadSnapshot(snap);
+            snapGen = snap.journalGeneration();
+            snap.close();
+        } else if (!readWholeFile(dbFile, data)) {
+            r.found = false;
+        }
+
+        vector<CatalogParser::Chunk> chunks;
+        CatalogParser::parse(data, loadThreads, chunks);
+        size_t count = 0;
+        for (size_t c = 0; c < chunks.size(); ++c) count += chunks[c].books.size();
+        vector<BookNode*> nodes;
+        nodes.reserve(count);
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            vector<ParsedBook> &books = chunks[c].books;
+            for (size_t i = 0; i < books.size(); ++i) {
+                nodes.push_back(newBook(books[i].id, books[i].title, books[i].author,
+                                        books[i].total, books[i].avail));
+            }
+            vector<ParsedBook>().swap(books);
+            r.malformed += chunks[c].malformedCount;
+            for (size_t i = 0; i < chunks[c].malformed.size() &&
+                               r.malformedLines.size() < CatalogParser::MAX_REPORTED; ++i) {
+                r.malformedLines.push_back(chunks[c].malformed[i]);
+            }
+        }
+
+        r.duplicates = bulkInsert(nodes);
+        uint64_t gen = 0;
+        bool prevLive = readJournal(prevJournalFile(), data, gen) && gen >= snapGen;
+        if (prevLive) replayJournal(data);
+        else if (!readOnly) remove(prevJournalFile().c_str());
+        if (readJournal(journal.fileName(), data, gen) && gen >= snapGen) {
+            size_t replayed = replayJournal(data);
+            journalGen = gen;
+            if (!readOnly) journal.open(replayed);
+        } else if (!readOnly) {
+            startJournal(snapGen);
+        }
+        string().swap(data);
+        // entries for every student known so far, so their first loan does
+        // not allocate
+        students.reserve(registry.size());
+        if (prevLive && journal.isOpen()) writeSnapshot();
+        r.journalOpen = journal.isOpen();
+        if (!r.found) LMS_FAIL(OP_LOAD);
+        return r;
+    }
+
+public:
+
+    // Links a batch of nodes into the list in O(n + m) (plus a sort if the
+    // batch is out of order), then rebuilds the ordered index in one pass. Nodes whose id is already present, in the list
+    // or earlier in the batch, are freed. Returns how many were dropped.
+    int bulkInsert(vector<BookNode*> &nodes) {
+        bool sorted = true;
+        for (size_t i = 1; i < nodes.size() && sorted; ++i) {
+            if (nodes[i]->id < nodes[i-1]->id) sorted = false;
+        }
+        if (!sorted) stable_sort(nodes.begin(), nodes.end(), idLess);
+
+        idIndex.reserve(idIndex.size() + nodes.size());
+        int dups = 0;
+        BookNode dummy(0, StrRef(), StrRef(), 0, 0);
+        dummy.next = head;
+        BookNode *tail = &dummy;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            BookNode *node = nodes[i];
+            while (tail->next != NULL && tail->next->id < node->id) {
+                tail = tail->next;
+            }
+            bool dup = (tail != &dummy && tail->id == node->id) ||
+                       (tail->next != NULL && tail->next->id == node->id);
+            if (dup) {
+                freeBook(node);
+                ++dups;
+                continue;
             }
-            cur = cur->next;
+            node->next = tail->next;
+            tail->next = node;
+            tail = node;
+            index(node, false);
         }
-        if (!found) cout << "No books with given title.\n";
+        head = dummy.next;
+        dummy.next = NULL;
+        orderIndex.build(head);
+        return dups;
+    }
+
+    static bool idLess(const BookNode *a, const BookNode *b) {
+        return a->id < b->id;
     }
 
-    void searchByAuthor(const string &q) const {
-        BookNode *cur = head;
-        bool found = false;
-        while (cur != NULL) {
-            if (cur->author.find(q) != string::npos) {
-                printBookDetails(cur);
-                found = true;
+    // Every mutation is already in the journal; saving only syncs what a
+    // batch may still hold, and folds the journal into a new snapshot once
+    // it has grown past the catalog size (so compaction is amortized O(1)).
+    // The snapshot is written by the saver thread; saves made while it runs
+    // are coalesced into it. If the journal cannot be written or the last
+    // background snapshot failed, a snapshot is written here instead. False
+    // if that could not be done either. Without a journal every save writes a snapshot, here.
+    bool saveToFile() {
+        LMS_TIME(OP_SAVE);
+        bool ok = true;
+        if (!journal.isOpen()) {
+            ok = writeSnapshot();
+        } else if (!journal.commit()) {
+            // the snapshot holds what the journal could not take
+            ok = writeSnapshot();
+        } else {
+            journalFailed.store(false);
+            if (saver.coalesce()) return true;
+            if (prevJournalPending && !saver.wait()) {
+                ok = writeSnapshot();
+            } else {
+                prevJournalPending = false;
+                size_t limit = idIndex.size() < 1024 ? 1024 : idIndex.size();
+                if (journal.size() > limit) ok = compactInBackground();
             }
-            cur = cur->next;
         }
-        if (!found) cout << "No books with given author.\n";
+        if (!ok) LMS_FAIL(OP_SAVE);
+        return ok;
+    }
+
+    // Waits for a background snapshot; false if the last one failed.
+    bool finishSaves() {
+        return saver.wait();
+    }
+
+    size_t backgroundSaves() const { return saver.completedJobs(); }
+    size_t coalescedSaves() const { return saver.coalescedRequests(); }
+
+    // Groups the journal records of several mutations into one commit. In
+    // concurrent mode only one thread may batch (CommandPipeline's writer);
+    // records other threads append meanwhile share its sync.
+    void beginBatch() {
+        if (batchDepth++ == 0) batchSeq = 0;
     }
 
-    void printBookDetails(BookNode *b) const {
-        cout << "-----------------------------\n";
-        cout << "Book ID: " << b->id << "\n";
-        cout << "Title: " << b->title << "\n";
-        cout << "Author: " << b->author << "\n";
-        cout << "Total copies: " << b->totalCopies << "\n";
-        cout << "Available copies: " << b->availableCopies << "\n";
-        cout << "In waiting queue: " << b->waitingCount() << "\n";
-        int cnt = 0;
-        IssuedRecord *ir = b->issuedHead;
-        while (ir != NULL) {
-            ++cnt;
-            ir = ir->next;
+    void endBatch() {
+        if (batchDepth > 0 && --batchDepth == 0) {
+            noteJournalWrite(concurrent ? journal.syncTo(batchSeq) : journal.commit());
         }
-        cout << "Currently issued: " << cnt << "\n";
-        cout << "-----------------------------\n";
     }
 
-    void displayAll() const {
-        if (head == NULL) {
-            cout << "No books in library.\n";
+    // Compaction on this thread: the whole library, loans and queues
+    // included, goes into a new binary snapshot and the journal starts over
+    // empty. books.txt is refreshed afterwards as a plain-text copy of the
+    // catalog. Waits for a background compaction first. False (and nothing
+    // replaced) if the snapshot cannot be written.
+    bool writeSnapshot() {
+        saver.wait();
+        FrozenCatalog img;
+        freeze(img);
+        img.generation = journalGen + 1;
+        if (!writeFrozen(img)) return false;
+        // every journal so far is in the snapshot now
+        journalGen = img.generation;
+        if (journal.isOpen()) startJournal(journalGen);
+        remove(prevJournalFile().c_str());
+        prevJournalPending = false;
+        journalFailed.store(false);
+        return true;
+    }
+
+    const string& snapshotFile() const {
+        return snapFile;
+    }
+
+    // True while a mutation reported LIB_OK is not on disk yet (the journal
+    // write failed); the next successful save clears it.
+    bool unsavedChanges() const {
+        return journalFailed.load();
+    }
+
+    // ---------- BASIC LIST OPS ----------
+    BookNode* firstBook() const {
+        return head;
+    }
+
+    BookNode* findById(int id) const {
+        return idIndex.find(id);
+    }
+
+    bool existsId(int id) const {
+        return findById(id) != NULL;
+    }
+
+    // Last book with an id below id (NULL: id goes first); O(log n)
+    BookNode* bookBefore(int id) const {
+        return id == INT_MIN ? NULL : orderIndex.floor(id - 1);
+    }
+
+    void insertSorted(BookNode *node) {
+        BookNode *prev = bookBefore(node->id);
+        index(node);
+        if (prev == NULL) {
+            node->next = head;
+            head = node;
             return;
         }
-        cout << "\n======= All Books =======\n";
-        BookNode *cur = head;
-        while (cur != NULL) {
-            cur->printBrief();
-            cur = cur->next;
+        node->next = prev->next;
+        prev->next = node;
+    }
+
+    // Unlinks and frees the book; false if there is no such id.
+    bool removeBook(int id) {
+        BookNode *prev = bookBefore(id);
+        BookNode *cur = prev != NULL ? prev->next : head;
+        if (cur == NULL || cur->id != id) return false;
+        if (prev != NULL) prev->next = cur->next;
+        else head = cur->next;
+        unindex(cur);
+        cur->next = NULL;
+        freeBook(cur);
+        return true;
+    }
+
+    // ---------- ID RANGES ----------
+    // First book with id >= fromId; O(log n)
+    BookNode* firstAtOrAfter(int fromId) const {
+        BookNode *prev = bookBefore(fromId);
+        return prev != NULL ? prev->next : head;
+    }
+
+    // Books with lo <= id <= hi, in id order; O(log n + k)
+    vector<BookNode*> booksInRange(int lo, int hi) const {
+        LMS_TIME(OP_RANGE);
+        vector<BookNode*> out;
+        for (BookNode *b = firstAtOrAfter(lo); b != NULL && b->id <= hi; b = b->next) {
+            out.push_back(b);
         }
-        cout << "=========================\n";
+        return out;
     }
 
-    void issueBook(const string &studentId) {
-        int id;
-        cout << "Enter Book ID to issue: ";
-        cin >> id;
-        BookNode *b = findById(id);
-        if (b == NULL) {
-            cout << "Book not found.\n";
-            return;
+    // ---------- PAGED LISTING ----------
+
+    // Up to pageSize books from fromId on, in id order, into out. Returns
+    // the first book of the following page (its id is the next cursor), or
+    // NULL if this page reaches the end of the catalog.
+    BookNode* catalogPage(int fromId, int pageSize, vector<BookNode*> &out) const {
+        out.clear();
+        BookNode *b = firstAtOrAfter(fromId);
+        while (b != NULL && (int)out.size() < pageSize) {
+            out.push_back(b);
+            b = b->next;
         }
+        return b;
+    }
 
-        if (b->findIssued(studentId) != NULL) {
-            cout << "You already have this book issued.\n";
-            return;
+    // ---------- EXPORT ----------
+    // Whole catalog, one line per book, to out in 64 KB writes (a header
+    // line first for TSV). False on a write error.
+    bool exportCatalog(FILE *out, ExportFormat fmt) const {
+        string buf;
+        if (fmt == EXPORT_TSV) buf = "id\ttitle\tauthor\ttotal\tavailable\twaiting\n";
+        bool ok = true;
+        for (BookNode *cur = head; cur != NULL && ok; cur = cur->next) {
+            if (fmt == EXPORT_TSV) cur->appendTsvLine(buf);
+            else cur->appendJsonLine(buf);
+            if (buf.size() >= (1 << 16)) {
+                ok = fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+                buf.clear();
+            }
         }
+        if (ok && !buf.empty()) ok = fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+        return fflush(out) == 0 && ok;
+    }
 
-        if (b->availableCopies > 0) {
-            Date issueDate;
-            inputDate(issueDate, "Enter issue date (dd mm yyyy): ");
-            Date due = addDays(issueDate, loanDays);
-            b->addIssued(studentId, issueDate, due);
-            b->availableCopies--;
+    // ---------- CONCURRENT USE ----------
+    // With setConcurrent(true) several threads may call issue / returnBook at
+    // once, provided the caller keeps them apart per book and holds adds,
+    // deletes and saves exclusive (see Server.h). Batches are single-thread
+    // only. Every book's counts are published for ReadSnapshot while it is
+    // on; call it with no other thread in the library.
+    void setConcurrent(bool on) {
+        if (on == concurrent) return;
+        concurrent = on;
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            if (on) publishCounts(cur);
+            else cur->version.store(NULL);
+        }
+        if (!on) versions.releaseAll();
+    }
+
+    // Book versions alive for snapshot readers (0 outside concurrent mode)
+    size_t bookVersionCount() const {
+        return versions.liveVersions();
+    }
 
-            cout << "Book issued successfully.\n";
-            cout << "Due date: ";
-            printDate(due);
-            cout << "\n";
+    // A consistent view of every book's counts as of construction. In
+    // concurrent mode they come from published versions, so no book lock
+    // is needed and a concurrent issue / return is seen entirely or not at
+    // all; otherwise the books are read directly. Hold the catalog against
+    // deletes (shared) while it lives.
+    class ReadSnapshot {
+        const Library &lib;
+        int slot;
+        uint64_t at;
+        ReadSnapshot(const ReadSnapshot&);
+        ReadSnapshot& operator=(const ReadSnapshot&);
+    public:
+        explicit ReadSnapshot(const Library &l) : lib(l), slot(-1), at(0) {
+            if (lib.concurrent) at = lib.versions.pin(slot);
+        }
+        ~ReadSnapshot() {
+            if (slot >= 0) lib.versions.unpin(slot);
+        }
+
+        // False if the book was added after the snapshot was taken
+        bool counts(const BookNode *b, int &available, int &waiting) const {
+            if (slot < 0) {
+                available = b->availableCopies;
+                waiting = b->waitCount;
+                return true;
+            }
+            const BookVersion *v = VersionStore::at(b->version, at);
+            if (v == NULL) return false;
+            available = v->available;
+            waiting = v->waiting;
+            return true;
+        }
+    };
+
+    // Holds the shared-state lock in concurrent mode, nothing otherwise.
+    // Readers of student entries or the due index take it too.
+    class StateGuard {
+        mutex *m;
+        StateGuard(const StateGuard&);
+        StateGuard& operator=(const StateGuard&);
+    public:
+        explicit StateGuard(const Library &lib)
+                : m(lib.concurrent ? &lib.stateMutex : NULL) {
+            if (m != NULL) m->lock();
+        }
+        ~StateGuard() {
+            if (m != NULL) m->unlock();
+        }
+    };
+
+    // Builds the search index now instead of on the first search, so that
+    // concurrent searches only ever read it.
+    void prepareSearch() const {
+        buildTextIndex();
+        buildFuzzyIndex();
+        buildPrefixIndex();
+    }
+
+    // Starts building the substring and typo-tolerant indexes on a thread
+    // of their own, so the first search after a large load does not pay
+    // for them (it only waits for whatever is left). Adds and deletes may
+    // go on meanwhile; call from the thread that makes them.
+    void prepareSearchInBackground() {
+        if (indexBuilder.joinable() || (textIndexed && fuzzyIndexed)) return;
+        vector<IndexChange> books;
+        books.reserve(idIndex.size());
+        for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+            IndexChange c = {true, cur->id, cur->title, cur->author};
+            books.push_back(c);
+        }
+        textPending = !textIndexed;
+        fuzzyPending = !fuzzyIndexed;
+        indexBuilder = thread(fillSearchIndexes, std::move(books),
+                              textPending ? &titleIndex : NULL,
+                              textPending ? &authorIndex : NULL,
+                              fuzzyPending ? &fuzzyTitleIndex : NULL,
+                              fuzzyPending ? &fuzzyAuthorIndex : NULL);
+    }
+
+    // ---------- CORE OPERATIONS ----------
+    // Each one is journaled as it happens; none of them does console I/O.
+    LibStatus addBook(int id, const string &title, const string &author, int total) {
+        LibStatus s = LIB_OK;
+        LMS_TIME_STATUS(OP_ADD, s);
+        if (existsId(id)) return s = LIB_DUPLICATE_ID;
+        if (total <= 0) return s = LIB_INVALID_COPIES;
+        BookNode *b = newBook(id, title, author, total, total);
+        insertSorted(b);
+        publishCounts(b);
+        string &rec = recordBuffer();
+        Journal::addRecord(rec, id, title, author, total, total);
+        logRecord(rec);
+        return LIB_OK;
+    }
+
+    LibStatus deleteBook(int id) {
+        LibStatus s = LIB_OK;
+        LMS_TIME_STATUS(OP_DELETE, s);
+        if (!removeBook(id)) return s = LIB_NOT_FOUND;
+        string &rec = recordBuffer();
+        Journal::deleteRecord(rec, id);
+        logRecord(rec);
+        return LIB_OK;
+    }
+
+    // Lends a free copy for loanDays from issueDate, or puts the student in
+    // the waiting queue when every copy is out (issueDate is then unused).
+    IssueResult issue(int bookId, const string &studentId, const Date &issueDate) {
+        IssueResult r;
+        r.status = LIB_OK;
+        LMS_TIME_STATUS(OP_ISSUE, r.status);
+        r.queuePosition = 0;
+        // a name gets its id only once it lends or queues, so failed
+        // requests do not grow the registry
+        StudentId student = 0;
+        bool known = registry.find(studentId, student);
+        BookNode *b = findById(bookId);
+        if (b == NULL) {
+            r.status = LIB_NOT_FOUND;
+        } else if (known && b->findIssued(student) != NULL) {
+            r.status = LIB_ALREADY_ISSUED;
+        } else if (b->availableCopies > 0) {
+            if (!isValidDate(issueDate)) {
+                r.status = LIB_INVALID_DATE;
+                return r;
+            }
+            if (!known) student = registry.idOf(studentId);
+            int issueDay = dayNumber(issueDate);
+            int dueDay = dayNumber(addDays(issueDate, loanDays));
+            {
+                StateGuard guard(*this);
+                lendTo(b, student, issueDay, dueDay);
+            }
+            b->availableCopies--;
+            publishCounts(b);
+            string &rec = recordBuffer();
+            Journal::issueRecord(rec, 'I', bookId, studentId, dayToKey(issueDay), dayToKey(dueDay));
+            logRecord(rec);
+            r.dueDate = dateFromDays(dueDay);
         } else {
-            if (b->isStudentInQueue(studentId)) {
-                cout << "You are already in the waiting queue.\n";
-                return;
+            if (!known) student = registry.idOf(studentId);
+            {
+                StateGuard guard(*this);
+                r.queuePosition = queuePositionOf(b, student);
+                if (r.queuePosition == 0) enqueueStudent(b, student);
+            }
+            if (r.queuePosition > 0) {
+                r.status = LIB_ALREADY_QUEUED;
+                return r;
             }
-            b->enqueueWait(studentId);
-            int pos = b->waitingCount();
-            cout << "No copies available now. You are added to waiting list.\n";
-            cout << "Your position in queue: " << pos << "\n";
+            publishCounts(b);
+            string &rec = recordBuffer();
+            Journal::studentRecord(rec, 'Q', bookId, studentId);
+            logRecord(rec);
+            r.status = LIB_QUEUED;
+            r.queuePosition = b->waitingCount();
         }
+        return r;
     }
 
-    void returnBook(const string &studentIdOpt = "") {
-        int id;
-        cout << "Enter Book ID to return: ";
-        cin >> id;
-        BookNode *b = findById(id);
+    // Takes the student's copy back on returnDate, works out the fine, and
+    // hands the copy to the front of the waiting queue if anyone is there.
+    ReturnResult returnBook(int bookId, const string &studentId, const Date &returnDate) {
+        ReturnResult r;
+        r.status = LIB_OK;
+        LMS_TIME_STATUS(OP_RETURN, r.status);
+        r.daysLate = 0;
+        r.fine = 0;
+        BookNode *b = findById(bookId);
         if (b == NULL) {
-            cout << "Book not found.\n";
-            return;
+            r.status = LIB_NOT_FOUND;
+            return r;
+        }
+        if (!isValidDate(returnDate)) {
+            r.status = LIB_INVALID_DATE;
+            return r;
         }
 
-        string studentId = studentIdOpt;
-        if (studentId.empty()) {
-            cout << "Enter Student ID who is returning: ";
-            cin >> studentId;
+        int returnDay = dayNumber(returnDate);
+        int nextDueDay = dayNumber(addDays(returnDate, loanDays));
+        StudentId student;
+        bool known = registry.find(studentId, student);
+        {
+            StateGuard guard(*this);
+            IssuedRecord *rec = known ? takeBack(b, student) : NULL;
+            if (rec == NULL) {
+                r.status = LIB_NOT_ISSUED;
+                return r;
+            }
+            r.dueDate = rec->dueDate();
+            if (returnDay > rec->dueDay) {
+                r.daysLate = returnDay - rec->dueDay;
+                r.fine = r.daysLate * finePerDay;
+            }
+            issuedPool.destroy(rec);
+
+            WaitNode *wn = dequeueStudent(b);
+            if (wn != NULL) {
+                r.nextStudent = registry.nameOf(wn->student);
+                lendTo(b, wn->student, returnDay, nextDueDay);
+                waitPool.destroy(wn);
+            }
+        }
+        if (r.nextStudent.empty()) b->availableCopies++;
+        publishCounts(b);
+        string &rec = recordBuffer();
+        Journal::studentRecord(rec, 'R', bookId, studentId);
+        logRecord(rec);
+        if (!r.nextStudent.empty()) {
+            Journal::autoIssueRecord(rec, bookId, dayToKey(returnDay), dayToKey(nextDueDay));
+            logRecord(rec);
+            r.nextDueDate = dateFromDays(nextDueDay);
         }
+        return r;
+    }
 
-        IssuedRecord *rec = NULL;
-        if (!b->removeIssued(studentId, rec)) {
-            cout << "This student does not have this book.\n";
-            return;
+    // ---------- SEARCH ----------
+    vector<BookNode*> findByTitle(const string &q) const {
+        LMS_TIME(OP_SEARCH);
+        return matchText(titleIndex, &BookNode::title, q);
+    }
+
+    vector<BookNode*> findByAuthor(const string &q) const {
+        LMS_TIME(OP_SEARCH);
+        return matchText(authorIndex, &BookNode::author, q);
+    }
+
+    // Typo-tolerant: up to k books ranked by trigram similarity, best first
+    // (see FuzzyIndex for the scoring).
+    vector<FuzzyMatch> fuzzyFindTitle(const string &q, size_t k) const {
+        LMS_TIME(OP_FUZZY_SEARCH);
+        return matchFuzzy(fuzzyTitleIndex, q, k);
+    }
+
+    vector<FuzzyMatch> fuzzyFindAuthor(const string &q, size_t k) const {
+        LMS_TIME(OP_FUZZY_SEARCH);
+        return matchFuzzy(fuzzyAuthorIndex, q, k);
+    }
+
+    // Autocomplete: up to n distinct titles / authors starting with prefix
+    // (case-insensitive), in alphabetical order.
+    vector<Completion> completeTitle(const string &prefix, size_t n) const {
+        LMS_TIME(OP_COMPLETE);
+        return completeFrom(titlePrefix, prefix, n);
+    }
+
+    vector<Completion> completeAuthor(const string &prefix, size_t n) const {
+        LMS_TIME(OP_COMPLETE);
+        return completeFrom(authorPrefix, prefix, n);
+    }
+
+    // Bytes held by each search index (0 until it has been built)
+    SearchIndexMemory searchIndexMemory() const {
+        SearchIndexMemory m;
+        m.substring = textIndexed ? titleIndex.memoryBytes() + authorIndex.memoryBytes() : 0;
+        m.fuzzy = fuzzyIndexed ? fuzzyTitleIndex.memoryBytes() + fuzzyAuthorIndex.memoryBytes() : 0;
+        m.prefix = prefixIndexed ? titlePrefix.memoryBytes() + authorPrefix.memoryBytes() : 0;
+        m.prefixKeys = titlePrefix.keyCount() + authorPrefix.keyCount();
+        m.prefixNodes = titlePrefix.nodeCount() + authorPrefix.nodeCount();
+        return m;
+    }
+
+    // ---------- METRICS ----------
+    // Catalog and allocator gauges in Prometheus text format, to go after
+    // Metrics::appendPrometheus. Call with adds and deletes held off.
+    void appendMetrics(string &out) const {
+        Metrics::appendGauge(out, "lms_catalog_books", "Books in the catalog.",
+                             (double)idIndex.size());
+        Metrics::appendGauge(out, "lms_string_pool_bytes", "Memory held by the title / author pool.",
+                             (double)strings.memoryBytes());
+        Metrics::appendGauge(out, "lms_unsaved_changes", "1 while the journal cannot be written.",
+                             unsavedChanges() ? 1.0 : 0.0);
+        {
+            StateGuard guard(*this);
+            Metrics::appendGauge(out, "lms_active_loans", "Copies currently lent out.",
+                                 (double)dueIndex.size());
+            Metrics::appendGauge(out, "lms_queued_students", "Waiting-queue places across all books.",
+                                 (double)queued.size());
+#if LMS_METRICS
+            Metrics::appendGauge(out, "lms_longest_wait_queue", "Students waiting for the most requested book.",
+                                 queueLengths.empty() ? 0.0 : (double)(queueLengths.size() - 1));
+#endif
+            Metrics::appendGauge(out, "lms_students", "Students with a loan or queue place on record.",
+                                 (double)students.size());
+            Metrics::appendGauge(out, "lms_book_versions", "Book versions held for snapshot readers.",
+                                 (double)versions.liveVersions());
+            const PoolStats *pools[3] = {&bookPool.statistics(), &waitPool.statistics(),
+                                         &issuedPool.statistics()};
+            const char *names[3] = {"book", "wait", "loan"};
+            char line[160];
+            out += "# HELP lms_pool_bytes Memory held by each node pool.\n"
+                   "# TYPE lms_pool_bytes gauge\n";
+            for (int i = 0; i < 3; ++i) {
+                out.append(line, snprintf(line, sizeof(line), "lms_pool_bytes{pool=\"%s\"} %llu\n",
+                                          names[i], (unsigned long long)pools[i]->bytes));
+            }
+            out += "# HELP lms_pool_live_objects Objects alive in each node pool.\n"
+                   "# TYPE lms_pool_live_objects gauge\n";
+            for (int i = 0; i < 3; ++i) {
+                out.append(line, snprintf(line, sizeof(line), "lms_pool_live_objects{pool=\"%s\"} %llu\n",
+                                          names[i], (unsigned long long)pools[i]->live));
+            }
         }
+    }
 
-        Date returnDate;
-        inputDate(returnDate, "Enter return date (dd mm yyyy): ");
+    // ---------- PER-STUDENT VIEW ----------
+    // Students are known by name at the API; loans and queue places hold
+    // the registry id (see StudentRegistry).
+    StudentRegistry& studentRegistry() { return registry; }
 
-        int delay = daysBetween(rec->dueDate, returnDate);
-        if (delay > 0) {
-            int fine = delay * finePerDay;
-            cout << "Book is returned late.\n";
-            cout << "Due date was: ";
-            printDate(rec->dueDate);
-            cout << "\nReturned on: ";
-            printDate(returnDate);
-            cout << "\nDays late: " << delay
-                 << " | Fine: " << fine << " units.\n";
-        } else {
-            cout << "Book returned on time. No fine.\n";
-        }
-        delete rec;
-
-        string nextStudent;
-        if (b->dequeueWait(nextStudent)) {
-            cout << "Next student in queue is: " << nextStudent << "\n";
-            Date issueDate = returnDate;
-            Date due = addDays(issueDate, loanDays);
-            b->addIssued(nextStudent, issueDate, due);
-            cout << "Book automatically issued to " << nextStudent << ".\n";
-            cout << "New due date: ";
-            printDate(due);
-            cout << "\n";
-        } else {
-            b->availableCopies++;
+    const string& studentName(StudentId student) const {
+        return registry.nameOf(student);
+    }
+
+    // NULL if the student never had a loan or queue place
+    const StudentEntry* findStudent(StudentId student) const {
+        return students.find(student);
+    }
+
+    const StudentEntry* findStudent(const string &studentId) const {
+        StudentId student;
+        return registry.find(studentId, student) ? findStudent(student) : NULL;
+    }
+
+    bool hasIssued(const BookNode *b, const string &studentId) const {
+        StudentId student;
+        return registry.find(studentId, student) && b->findIssued(student) != NULL;
+    }
+
+    bool isInQueue(const BookNode *b, const string &studentId) const {
+        return queuePositionOf(b, studentId) > 0;
+    }
+
+    // 1-based place of the student in the book's queue, 0 if not queued
+    int queuePositionOf(const BookNode *b, StudentId student) const {
+        const StudentEntry *st = findStudent(student);
+        if (st == NULL) return 0;
+        WaitNode *wn = queued.find(b, st);
+        return wn == NULL ? 0 : b->queuePosition(wn);
+    }
+
+    int queuePositionOf(const BookNode *b, const string &studentId) const {
+        StudentId student;
+        return registry.find(studentId, student) ? queuePositionOf(b, student) : 0;
+    }
+
+    // ---------- OVERDUE REPORT ----------
+    struct OverdueLoan {
+        IssuedRecord *loan;
+        int daysLate;
+        int fine;
+    };
+
+
+    // Loans that would be fined if returned on asOf, most overdue first.
+    // O(k log k) for k overdue loans, independent of the catalog size.
+    vector<OverdueLoan> overdueAsOf(const Date &asOf) const {
+        vector<IssuedRecord*> due;
+        int asOfDay = dayNumber(asOf);
+        dueIndex.collectDueBefore(asOfDay, due);
+        vector<OverdueLoan> out;
+        out.reserve(due.size());
+        for (size_t i = 0; i < due.size(); ++i) {
+            OverdueLoan o;
+            o.loan = due[i];
+            o.daysLate = asOfDay - due[i]->dueDay;
+            o.fine = o.daysLate * finePerDay;
+            out.push_back(o);
         }
+        // most overdue first, then book id, then student name
+        sort(out.begin(), out.end(), [this](const OverdueLoan &a, const OverdueLoan &b) {
+            if (a.loan->dueDay != b.loan->dueDay) return a.loan->dueDay < b.loan->dueDay;
+            if (a.loan->book->id != b.loan->book->id) return a.loan->book->id < b.loan->book->id;
+            return registry.nameOf(a.loan->student) < registry.nameOf(b.loan->student);
+        });
+        return out;
     }
 
-    void deleteBookInteractive() {
-        int id;
-        cout << "Enter Book ID to delete: ";
-        cin >> id;
-        deleteBookById(id);
+    size_t activeLoanCount() const {
+        return dueIndex.size();
     }
 };
 
@@ -1,8 +1,447 @@
 #include <iostream>
+#include <limits>
+#include <csignal>
 #include "Library.h"
 #include "User.h"
+#include "Server.h"
 using namespace std;
 
+// ========================= CONSOLE FRONT END =========================
+// Prompts and messages on top of the Library core operations.
+
+const char* statusMessage(LibStatus s) {
+    switch (s) {
+        case LIB_NOT_FOUND:       return "Book not found.";
+        case LIB_DUPLICATE_ID:    return "Book with this ID already exists.";
+        case LIB_INVALID_COPIES:  return "Total copies must be positive.";
+        case LIB_INVALID_DATE:    return "Invalid date.";
+        case LIB_ALREADY_ISSUED:  return "You already have this book issued.";
+        case LIB_ALREADY_QUEUED:  return "You are already in the waiting queue.";
+        case LIB_NOT_ISSUED:      return "This student does not have this book.";
+        default:                  return "";
+    }
+}
+
+// After a mutation: the library has it, but the journal did not take it
+void warnIfUnsaved(const Library &lib) {
+    if (lib.unsavedChanges()) {
+        cout << "Warning: cannot write the journal, this change is not saved yet.\n";
+    }
+}
+
+void printBookDetails(BookNode *b) {
+    cout << "-----------------------------\n";
+    cout << "Book ID: " << b->id << "\n";
+    cout << "Title: " << b->title << "\n";
+    cout << "Author: " << b->author << "\n";
+    cout << "Total copies: " << b->totalCopies << "\n";
+    cout << "Available copies: " << b->availableCopies << "\n";
+    cout << "In waiting queue: " << b->waitingCount() << "\n";
+    int cnt = 0;
+    IssuedRecord *ir = b->issuedHead;
+    while (ir != NULL) {
+        ++cnt;
+        ir = ir->next;
+    }
+    cout << "Currently issued: " << cnt << "\n";
+    cout << "-----------------------------\n";
+}
+
+// Paged listing from a chosen book ID. Each page is formatted into one
+// buffer and written at once; page size 0 lists everything without stopping.
+void displayAll(const Library &lib) {
+    if (lib.firstBook() == NULL) {
+        cout << "No books in library.\n";
+        return;
+    }
+    int fromId = 0, pageSize = 0;
+    cout << "Start from book ID (0 = first): ";
+    cin >> fromId;
+    cout << "Books per page (0 = all): ";
+    cin >> pageSize;
+    if (fromId == 0) fromId = numeric_limits<int>::min();
+    bool paged = pageSize > 0;
+    if (!paged) pageSize = 4096;
+
+    cout << "\n======= All Books =======\n";
+    vector<BookNode*> rows;
+    string page;
+    while (true) {
+        BookNode *next = lib.catalogPage(fromId, pageSize, rows);
+        page.clear();
+        for (size_t i = 0; i < rows.size(); ++i) rows[i]->appendBrief(page);
+        cout.write(page.data(), (streamsize)page.size());
+        if (next == NULL) break;
+        fromId = next->id;
+        if (!paged) continue;
+        int more = 0;
+        cout << "-- Next page starts at ID " << next->id << ". 1 = show it, 0 = stop: ";
+        cin >> more;
+        if (more != 1) break;
+    }
+    cout << "=========================\n";
+}
+
+void printMatches(const vector<BookNode*> &hits, const char *none) {
+    for (size_t i = 0; i < hits.size(); ++i) printBookDetails(hits[i]);
+    if (hits.empty()) cout << none << "\n";
+}
+
+// Best match first, with its similarity as a percentage
+void printRanked(const vector<FuzzyMatch> &hits) {
+    if (hits.empty()) {
+        cout << "No similar books found.\n";
+        return;
+    }
+    string out;
+    char pct[16];
+    for (size_t i = 0; i < hits.size(); ++i) {
+        out.append(pct, snprintf(pct, sizeof(pct), "%3d%% | ", (int)(hits[i].score * 100 + 0.5)));
+        hits[i].book->appendBrief(out);
+    }
+    cout.write(out.data(), (streamsize)out.size());
+}
+
+void printCompletions(const char *heading, const vector<Completion> &hits,
+                      StrRef BookNode::*field) {
+    cout << heading << ":";
+    if (hits.empty()) cout << " (none)";
+    cout << "\n";
+    for (size_t i = 0; i < hits.size(); ++i) {
+        cout << "  " << hits[i].book->*field;
+        if (hits[i].books > 1) cout << "  (" << hits[i].books << " books)";
+        else cout << "  (ID " << hits[i].book->id << ")";
+        cout << "\n";
+    }
+}
+
+void searchMenu(const Library &lib) {
+    if (lib.firstBook() == NULL) {
+        cout << "No books in library.\n";
+        return;
+    }
+    int choice;
+    cout << "\nSearch by:\n";
+    cout << "1. Book ID\n";
+    cout << "2. Title\n";
+    cout << "3. Author\n";
+    cout << "4. Title, typo-tolerant (best 10)\n";
+    cout << "5. Author, typo-tolerant (best 10)\n";
+    cout << "6. Autocomplete title / author\n";
+    cout << "7. Book ID range (shelf / department)\n";
+    cout << "Choice: ";
+    cin >> choice;
+
+    if (choice == 1) {
+        int id;
+        cout << "Enter ID: ";
+        cin >> id;
+        BookNode *b = lib.findById(id);
+        if (b == NULL) cout << "Book not found.\n";
+        else printBookDetails(b);
+    } else if (choice == 2) {
+        string q;
+        cout << "Enter title keyword: ";
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        getline(cin, q);
+        printMatches(lib.findByTitle(q), "No books with given title.");
+    } else if (choice == 3) {
+        string q;
+        cout << "Enter author keyword: ";
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        getline(cin, q);
+        printMatches(lib.findByAuthor(q), "No books with given author.");
+    } else if (choice == 4 || choice == 5) {
+        string q;
+        cout << (choice == 4 ? "Enter title (approximate): " : "Enter author (approximate): ");
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        getline(cin, q);
+        printRanked(choice == 4 ? lib.fuzzyFindTitle(q, 10) : lib.fuzzyFindAuthor(q, 10));
+    } else if (choice == 6) {
+        string prefix;
+        cout << "Start typing a title or author: ";
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        getline(cin, prefix);
+        printCompletions("Titles", lib.completeTitle(prefix, 10), &BookNode::title);
+        printCompletions("Authors", lib.completeAuthor(prefix, 10), &BookNode::author);
+    } else if (choice == 7) {
+        int lo, hi;
+        cout << "From ID: ";
+        cin >> lo;
+        cout << "To ID: ";
+        cin >> hi;
+        vector<BookNode*> hits = lib.booksInRange(lo, hi);
+        string out;
+        for (size_t i = 0; i < hits.size(); ++i) hits[i]->appendBrief(out);
+        cout.write(out.data(), (streamsize)out.size());
+        if (hits.empty()) cout << "No books in that ID range.\n";
+    } else {
+        cout << "Invalid choice.\n";
+    }
+}
+
+void addBookMenu(Library &lib) {
+    int id, total;
+    string title, author;
+
+    cout << "Enter Book ID (integer): ";
+    cin >> id;
+    if (cin.fail()) {
+        cin.clear();
+        cin.ignore(10000, '\n');
+        cout << "Invalid ID.\n";
+        return;
+    }
+    if (lib.existsId(id)) {
+        cout << statusMessage(LIB_DUPLICATE_ID) << "\n";
+        return;
+    }
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+    cout << "Enter title: ";
+    getline(cin, title);
+    cout << "Enter author: ";
+    getline(cin, author);
+
+    cout << "Total copies: ";
+    cin >> total;
+    LibStatus st = lib.addBook(id, title, author, total);
+    if (st == LIB_OK) cout << "Book added successfully.\n";
+    else cout << statusMessage(st) << "\n";
+    warnIfUnsaved(lib);
+}
+
+void deleteBookMenu(Library &lib) {
+    int id;
+    cout << "Enter Book ID to delete: ";
+    cin >> id;
+    if (lib.firstBook() == NULL) return;
+    LibStatus st = lib.deleteBook(id);
+    if (st == LIB_OK) cout << "Book deleted.\n";
+    else cout << statusMessage(st) << "\n";
+    warnIfUnsaved(lib);
+}
+
+void issueBookMenu(Library &lib, const string &studentId) {
+    int id;
+    cout << "Enter Book ID to issue: ";
+    cin >> id;
+    // the date is only asked for when a copy will actually be lent
+    BookNode *b = lib.findById(id);
+    Date issueDate;
+    if (b != NULL && b->availableCopies > 0 && !lib.hasIssued(b, studentId)) {
+        inputDate(issueDate, "Enter issue date (dd mm yyyy): ");
+    }
+
+    IssueResult r = lib.issue(id, studentId, issueDate);
+    if (r.status == LIB_OK) {
+        cout << "Book issued successfully.\n";
+        cout << "Due date: ";
+        printDate(r.dueDate);
+        cout << "\n";
+    } else if (r.status == LIB_QUEUED) {
+        cout << "No copies available now. You are added to waiting list.\n";
+        cout << "Your position in queue: " << r.queuePosition << "\n";
+    } else {
+        cout << statusMessage(r.status) << "\n";
+    }
+    warnIfUnsaved(lib);
+}
+
+void returnBookMenu(Library &lib, const string &studentIdOpt = "") {
+    if (!studentIdOpt.empty()) {
+        // a student returning their own book first sees what they hold
+        const StudentEntry *st = lib.findStudent(studentIdOpt);
+        if (st == NULL || st->loanCount == 0) {
+            cout << "You have no books issued.\n";
+            return;
+        }
+        cout << "Your books:\n";
+        for (IssuedRecord *ir = st->loans; ir != NULL; ir = ir->studentNext) {
+            cout << "  ID: " << ir->book->id << " | Title: " << ir->book->title << "\n";
+        }
+    }
+    int id;
+    cout << "Enter Book ID to return: ";
+    cin >> id;
+    BookNode *b = lib.findById(id);
+    if (b == NULL) {
+        cout << statusMessage(LIB_NOT_FOUND) << "\n";
+        return;
+    }
+
+    string studentId = studentIdOpt;
+    if (studentId.empty()) {
+        cout << "Enter Student ID who is returning: ";
+        cin >> studentId;
+    }
+    if (!lib.hasIssued(b, studentId)) {
+        cout << statusMessage(LIB_NOT_ISSUED) << "\n";
+        return;
+    }
+
+    Date returnDate;
+    inputDate(returnDate, "Enter return date (dd mm yyyy): ");
+    ReturnResult r = lib.returnBook(id, studentId, returnDate);
+    if (r.status != LIB_OK) {
+        cout << statusMessage(r.status) << "\n";
+        return;
+    }
+    if (r.daysLate > 0) {
+        cout << "Book is returned late.\n";
+        cout << "Due date was: ";
+        printDate(r.dueDate);
+        cout << "\nReturned on: ";
+        printDate(returnDate);
+        cout << "\nDays late: " << r.daysLate
+             << " | Fine: " << r.fine << " units.\n";
+    } else {
+        cout << "Book returned on time. No fine.\n";
+    }
+    if (!r.nextStudent.empty()) {
+        cout << "Next student in queue is: " << r.nextStudent << "\n";
+        cout << "Book automatically issued to " << r.nextStudent << ".\n";
+        cout << "New due date: ";
+        printDate(r.nextDueDate);
+        cout << "\n";
+    }
+    warnIfUnsaved(lib);
+}
+
+// What the student currently holds and waits for: O(k) in their entries
+void printStudentStatus(const Library &lib, const string &studentId) {
+    const StudentEntry *st = lib.findStudent(studentId);
+    if (st == NULL || (st->loanCount == 0 && st->waitCount == 0)) {
+        cout << studentId << " has no books issued and is not in any queue.\n";
+        return;
+    }
+    cout << "\n===== " << studentId << " =====\n";
+    cout << "Books issued: " << st->loanCount << "\n";
+    for (IssuedRecord *ir = st->loans; ir != NULL; ir = ir->studentNext) {
+        cout << "ID: " << ir->book->id
+             << " | Title: " << ir->book->title << " | Due: ";
+        printDate(ir->dueDate());
+        cout << "\n";
+    }
+    cout << "Waiting for: " << st->waitCount << "\n";
+    for (WaitNode *wn = st->waits; wn != NULL; wn = wn->studentNext) {
+        cout << "ID: " << wn->book->id
+             << " | Title: " << wn->book->title
+             << " | Position: " << wn->book->queuePosition(wn) << "\n";
+    }
+}
+
+void overdueReport(const Library &lib) {
+    Date asOf;
+    inputDate(asOf, "Report date (dd mm yyyy): ");
+    vector<Library::OverdueLoan> rows = lib.overdueAsOf(asOf);
+    if (rows.empty()) {
+        cout << "No overdue books.\n";
+        return;
+    }
+    long long total = 0;
+    cout << "\n======= Overdue as of ";
+    printDate(asOf);
+    cout << " =======\n";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const IssuedRecord *ir = rows[i].loan;
+        cout << "ID: " << ir->book->id
+             << " | Title: " << ir->book->title
+             << " | Student: " << lib.studentName(ir->student) << " | Due: ";
+        printDate(ir->dueDate());
+        cout << " | Days late: " << rows[i].daysLate
+             << " | Fine: " << rows[i].fine << "\n";
+        total += rows[i].fine;
+    }
+    cout << "Overdue loans: " << rows.size()
+         << " | Total fines: " << total << " units.\n";
+}
+
+bool exportToFile(const Library &lib, ExportFormat fmt, const string &file) {
+    FILE *f = file == "-" ? stdout : fopen(file.c_str(), "w");
+    if (f == NULL) return false;
+    bool ok = lib.exportCatalog(f, fmt);
+    if (f != stdout) ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+void exportMenu(const Library &lib) {
+    int fmt;
+    string file;
+    cout << "Format (1 = TSV, 2 = JSON lines): ";
+    cin >> fmt;
+    if (fmt != 1 && fmt != 2) {
+        cout << "Invalid choice.\n";
+        return;
+    }
+    cout << "Output file: ";
+    cin >> file;
+    if (exportToFile(lib, fmt == 1 ? EXPORT_TSV : EXPORT_JSONL, file)) {
+        cout << "Catalog exported to " << file << ".\n";
+    } else {
+        cout << "Cannot write " << file << ".\n";
+    }
+}
+
+// Search indexes are built on first use; one that is not built shows 0.
+void memoryReport(const Library &lib) {
+    SearchIndexMemory m = lib.searchIndexMemory();
+    cout << fixed << setprecision(2);
+    cout << "Substring index: " << m.substring / 1048576.0 << " MB\n";
+    cout << "Fuzzy index:     " << m.fuzzy / 1048576.0 << " MB\n";
+    cout << "Prefix index:    " << m.prefix / 1048576.0 << " MB ("
+         << m.prefixKeys << " keys, " << m.prefixNodes << " nodes)\n";
+    const StringPool &pool = lib.stringPool();
+    cout << "String pool:     " << pool.memoryBytes() / 1048576.0 << " MB ("
+         << pool.size() << " distinct titles / authors)\n";
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
+
+// Counters, latency histograms and gauges, Prometheus text format
+const char *METRICS_FILE = "metrics.prom";
+const int METRICS_INTERVAL = 10;        // seconds between dumps in server mode
+
+void writeMetrics(const Library &lib) {
+    string text;
+    Metrics::global().appendPrometheus(text);
+    lib.appendMetrics(text);
+    if (writeMetricsFile(METRICS_FILE, text)) {
+        cout << "Metrics written to " << METRICS_FILE << ".\n";
+    } else {
+        cout << "Cannot write " << METRICS_FILE << ".\n";
+    }
+}
+
+void saveChanges(Library &lib) {
+    if (!lib.saveToFile()) {
+        cout << "Cannot write snapshot " << lib.snapshotFile() << ".\n";
+    }
+}
+
+void loadLibrary(Library &lib, const string &dbFile) {
+    LoadResult r = lib.loadFromFile();
+    if (!r.found) {
+        cout << "No existing book database found, starting empty.\n";
+    }
+    if (r.duplicates > 0) {
+        cout << "Skipped " << r.duplicates << " duplicate book ID(s) in "
+             << dbFile << ".\n";
+    }
+    for (size_t i = 0; i < r.malformedLines.size(); ++i) {
+        const MalformedLine &m = r.malformedLines[i];
+        cout << dbFile << ": malformed line at byte " << m.offset << " (" << m.reason
+             << (m.skipped ? ", skipped" : "") << ").\n";
+    }
+    if (r.malformed > r.malformedLines.size()) {
+        cout << dbFile << ": " << r.malformed - r.malformedLines.size()
+             << " more malformed line(s).\n";
+    }
+    if (!r.journalOpen) {
+        cout << "Cannot open " << dbFile << ".journal, changes will not be saved.\n";
+    }
+}
+
 void adminMenu(Library &lib, AuthSystem &auth) {
     int choice;
     do {
@@ -12,17 +451,23 @@ void adminMenu(Library &lib, AuthSystem &auth) {
         cout << "3. Display all books\n";
         cout << "4. Search books\n";
         cout << "5. Register new student\n";
+        cout << "6. Export catalog (TSV / JSON lines)\n";
+        cout << "7. Index and string memory\n";
+        cout << "8. Write metrics file\n";
         cout << "0. Save & logout\n";
         cout << "Choice: ";
         cin >> choice;
 
         switch (choice) {
-            case 1: lib.addBookInteractive(); break;
-            case 2: lib.deleteBookInteractive(); break;
-            case 3: lib.displayAll(); break;
-            case 4: lib.searchMenu(); break;
+            case 1: addBookMenu(lib); break;
+            case 2: deleteBookMenu(lib); break;
+            case 3: displayAll(lib); break;
+            case 4: searchMenu(lib); break;
             case 5: auth.registerStudent(); break;
-            case 0: lib.saveToFile(); cout << "Changes saved.\n"; break;
+            case 6: exportMenu(lib); break;
+            case 7: memoryReport(lib); break;
+            case 8: writeMetrics(lib); break;
+            case 0: saveChanges(lib); cout << "Changes saved.\n"; break;
             default: cout << "Invalid choice.\n";
         }
     } while (choice != 0);
@@ -37,23 +482,33 @@ void librarianMenu(Library &lib) {
         cout << "3. Return book\n";
         cout << "4. Display all books\n";
         cout << "5. Search books\n";
+        cout << "6. Student loans and reservations\n";
+        cout << "7. Overdue report\n";
         cout << "0. Save & logout\n";
         cout << "Choice: ";
         cin >> choice;
 
         switch (choice) {
-            case 1: lib.addBookInteractive(); break;
+            case 1: addBookMenu(lib); break;
             case 2: {
                 string sid;
                 cout << "Enter Student ID: ";
                 cin >> sid;
-                lib.issueBook(sid);
+                issueBookMenu(lib, sid);
+                break;
+            }
+            case 3: returnBookMenu(lib); break;
+            case 4: displayAll(lib); break;
+            case 5: searchMenu(lib); break;
+            case 6: {
+                string sid;
+                cout << "Enter Student ID: ";
+                cin >> sid;
+                printStudentStatus(lib, sid);
                 break;
             }
-            case 3: lib.returnBook(); break;
-            case 4: lib.displayAll(); break;
-            case 5: lib.searchMenu(); break;
-            case 0: lib.saveToFile(); cout << "Changes saved.\n"; break;
+            case 7: overdueReport(lib); break;
+            case 0: saveChanges(lib); cout << "Changes saved.\n"; break;
             default: cout << "Invalid choice.\n";
         }
     } while (choice != 0);
@@ -67,22 +522,111 @@ void studentMenu(Library &lib, const User &user) {
         cout << "2. Request / Issue book\n";
         cout << "3. Return book\n";
         cout << "4. View all books (read-only)\n";
+        cout << "5. My loans and reservations\n";
         cout << "0. Logout\n";
         cout << "Choice: ";
         cin >> choice;
 
         switch (choice) {
-            case 1: lib.searchMenu(); break;
-            case 2: lib.issueBook(user.username); break;
-            case 3: lib.returnBook(user.username); break;
-            case 4: lib.displayAll(); break;
+            case 1: searchMenu(lib); break;
+            case 2: issueBookMenu(lib, user.username); break;
+            case 3: returnBookMenu(lib, user.username); break;
+            case 4: displayAll(lib); break;
+            case 5: printStudentStatus(lib, user.username); break;
             case 0: cout << "Logging out...\n"; break;
             default: cout << "Invalid choice.\n";
         }
     } while (choice != 0);
 }
 
-int main() {
+// Converters between books.txt and the binary snapshot format
+int convertMain(const string &mode, const string &from, const string &to) {
+    bool ok;
+    if (mode == "--to-binary") {
+        ok = convertTextToSnapshot(from, to);
+    } else if (mode == "--to-text") {
+        ok = convertSnapshotToText(from, to);
+    } else {
+        cout << "Usage: Main [--to-binary books.txt books.txt.snap]\n"
+             << "            [--to-text books.txt.snap books.txt]\n"
+             << "            [--server [library.sock] [--pipeline]]\n"
+             << "            [--export tsv|jsonl [file]]\n";
+        return 1;
+    }
+    cout << (ok ? "Converted " : "Cannot convert ") << from << " -> " << to << "\n";
+    return ok ? 0 : 1;
+}
+
+// Multi-session mode: serves the same library over a Unix socket until an
+// admin sends SHUTDOWN or the process gets SIGINT / SIGTERM. With
+// --pipeline, mutations are applied by one writer thread (CommandPipeline).
+LibraryServer *activeServer = NULL;
+
+void stopServer(int) {
+    if (activeServer != NULL) activeServer->stop();
+}
+
+int serverMain(const string &socketPath, bool pipelined) {
+    AuthSystem auth;
+    auth.ensureDefaultUsers();
+    Library lib;
+    auth.attachRegistry(&lib.studentRegistry());
+    loadLibrary(lib, "books.txt");
+
+    LibraryServer server(lib, auth, socketPath, pipelined);
+    if (!server.start()) {
+        cout << "Cannot listen on " << socketPath << ".\n";
+        return 1;
+    }
+    activeServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    cout << "Serving on " << socketPath << (pipelined ? " with a single writer" : "")
+         << " (Ctrl+C to stop).\n";
+    MetricsDumper dumper([&server] { writeMetricsFile(METRICS_FILE, server.metricsText()); },
+                         METRICS_INTERVAL);
+    server.serve();
+    activeServer = NULL;
+    cout << "Server stopped, changes saved.\n";
+    return 0;
+}
+
+// Streams the catalog as TSV or JSON lines to a file or stdout ("-"), for
+// piping into other tools. Messages go to stderr so stdout stays clean.
+int exportMain(const string &format, const string &file) {
+    if (format != "tsv" && format != "jsonl") {
+        cerr << "Usage: Main --export tsv|jsonl [file]\n";
+        return 1;
+    }
+    Library lib;
+    // read-only: a server may own these files right now
+    if (!lib.loadReadOnly().found) {
+        cerr << "No existing book database found.\n";
+    }
+    if (!exportToFile(lib, format == "tsv" ? EXPORT_TSV : EXPORT_JSONL, file)) {
+        cerr << "Cannot write " << file << ".\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "--export") {
+        return exportMain(argc > 2 ? argv[2] : "", argc > 3 ? argv[3] : "-");
+    }
+    if (argc > 1 && string(argv[1]) == "--server") {
+        string socketPath = "library.sock";
+        bool pipelined = false;
+        for (int i = 2; i < argc; ++i) {
+            if (string(argv[i]) == "--pipeline") pipelined = true;
+            else socketPath = argv[i];
+        }
+        return serverMain(socketPath, pipelined);
+    }
+    if (argc > 1) {
+        return convertMain(argv[1], argc > 2 ? argv[2] : "", argc > 3 ? argv[3] : "");
+    }
+
     cout << "==== DATA STRUCTURES PROJECT: LIBRARY MANAGEMENT SYSTEM ====\n";
     cout << "Linked List + Queue + File Handling + Login + Due Dates/Fines\n\n";
 
@@ -90,7 +634,9 @@ int main() {
     auth.ensureDefaultUsers();
 
     Library lib;
-    lib.loadFromFile();
+    auth.attachRegistry(&lib.studentRegistry());
+    loadLibrary(lib, "books.txt");
+    lib.prepareSearchInBackground();
 
     while (true) {
         User currentUser;
@@ -101,7 +647,10 @@ int main() {
         cin >> mainChoice;
 
         if (mainChoice == 2) {
-            lib.saveToFile();
+            saveChanges(lib);
+            if (!lib.finishSaves()) {
+                cout << "Cannot write snapshot " << lib.snapshotFile() << ".\n";
+            }
             cout << "Goodbye!\n";
             break;
         }
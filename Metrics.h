@@ -0,0 +1,242 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+using namespace std;
+
+// ========================= METRICS =========================
+// Process-wide operation counters and latency histograms, plus gauges the
+// caller adds at dump time, written in the Prometheus text format.
+//
+// Build with -DLMS_METRICS=0 to compile the instrumentation out: the
+// LMS_TIME / LMS_FAIL macros then expand to nothing.
+//
+// Histograms have one bucket per power of two nanoseconds; recording is
+// two clock reads and two relaxed atomic adds.
+
+#ifndef LMS_METRICS
+#define LMS_METRICS 1
+#endif
+
+enum MetricOp {
+    OP_ADD,
+    OP_DELETE,
+    OP_ISSUE,
+    OP_RETURN,
+    OP_SEARCH,
+    OP_FUZZY_SEARCH,
+    OP_COMPLETE,
+    OP_RANGE,
+    OP_LOAD,
+    OP_SAVE,
+    OP_SNAPSHOT,
+    OP_LOGIN,
+    OP_COUNT
+};
+
+inline const char* metricOpName(MetricOp op) {
+    static const char *names[OP_COUNT] = {
+        "add", "delete", "issue", "return", "search", "fuzzy_search",
+        "complete", "range", "load", "save", "snapshot", "login"
+    };
+    return names[op];
+}
+
+class LatencyHistogram {
+public:
+    enum { BUCKETS = 40 };          // <= 2^0 .. 2^39 ns (about 9 minutes)
+
+private:
+    atomic<uint64_t> buckets[BUCKETS];
+    atomic<uint64_t> sumNs;
+
+    // Smallest b with ns <= 2^b, capped at the last bucket
+    static int bucketFor(uint64_t ns) {
+        int b = ns <= 1 ? 0 : 64 - __builtin_clzll(ns - 1);
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+public:
+    LatencyHistogram() : sumNs(0) {
+        for (int i = 0; i < BUCKETS; ++i) buckets[i] = 0;
+    }
+
+    void record(uint64_t ns) {
+        buckets[bucketFor(ns)].fetch_add(1, memory_order_relaxed);
+        sumNs.fetch_add(ns, memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (int i = 0; i < BUCKETS; ++i) n += buckets[i].load(memory_order_relaxed);
+        return n;
+    }
+
+    // Cumulative Prometheus buckets, in seconds; empty leading and trailing
+    // buckets are left out.
+    void appendPrometheus(string &out, const string &name, const char *op) const {
+        uint64_t counts[BUCKETS];
+        int first = -1, last = -1;
+        for (int i = 0; i < BUCKETS; ++i) {
+            counts[i] = buckets[i].load(memory_order_relaxed);
+            if (counts[i] != 0) {
+                if (first < 0) first = i;
+                last = i;
+            }
+        }
+        char line[160];
+        uint64_t cum = 0;
+        for (int i = first; i >= 0 && i <= last; ++i) {
+            cum += counts[i];
+            out.append(line, snprintf(line, sizeof(line), "%s_bucket{op=\"%s\",le=\"%.9g\"} %llu\n",
+                                      name.c_str(), op, (double)(1ULL << i) * 1e-9,
+                                      (unsigned long long)cum));
+        }
+        out.append(line, snprintf(line, sizeof(line), "%s_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+                                  name.c_str(), op, (unsigned long long)cum));
+        out.append(line, snprintf(line, sizeof(line), "%s_sum{op=\"%s\"} %.9f\n",
+                                  name.c_str(), op, sumNs.load(memory_order_relaxed) * 1e-9));
+        out.append(line, snprintf(line, sizeof(line), "%s_count{op=\"%s\"} %llu\n",
+                                  name.c_str(), op, (unsigned long long)cum));
+    }
+};
+
+class Metrics {
+    LatencyHistogram latency[OP_COUNT];
+    atomic<uint64_t> failures[OP_COUNT];
+
+    Metrics() {
+        for (int i = 0; i < OP_COUNT; ++i) failures[i] = 0;
+    }
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+
+public:
+    static Metrics& global() {
+        static Metrics m;
+        return m;
+    }
+
+    void record(MetricOp op, uint64_t ns) { latency[op].record(ns); }
+    void fail(MetricOp op) { failures[op].fetch_add(1, memory_order_relaxed); }
+
+    uint64_t count(MetricOp op) const { return latency[op].count(); }
+    uint64_t failureCount(MetricOp op) const { return failures[op].load(memory_order_relaxed); }
+
+    // Counters and histograms; ops never called are left out.
+    void appendPrometheus(string &out) const {
+        char line[128];
+        out += "# HELP lms_operations_total Library operations by type.\n"
+               "# TYPE lms_operations_total counter\n";
+        for (int i = 0; i < OP_COUNT; ++i) {
+            if (count((MetricOp)i) == 0) continue;
+            out.append(line, snprintf(line, sizeof(line), "lms_operations_total{op=\"%s\"} %llu\n",
+                                      metricOpName((MetricOp)i),
+                                      (unsigned long long)count((MetricOp)i)));
+        }
+        out += "# HELP lms_operation_failures_total Operations that returned an error.\n"
+               "# TYPE lms_operation_failures_total counter\n";
+        for (int i = 0; i < OP_COUNT; ++i) {
+            if (count((MetricOp)i) == 0) continue;
+            out.append(line, snprintf(line, sizeof(line), "lms_operation_failures_total{op=\"%s\"} %llu\n",
+                                      metricOpName((MetricOp)i),
+                                      (unsigned long long)failureCount((MetricOp)i)));
+        }
+        out += "# HELP lms_operation_seconds Operation latency.\n"
+               "# TYPE lms_operation_seconds histogram\n";
+        for (int i = 0; i < OP_COUNT; ++i) {
+            if (count((MetricOp)i) == 0) continue;
+            latency[i].appendPrometheus(out, "lms_operation_seconds", metricOpName((MetricOp)i));
+        }
+    }
+
+    static void appendGauge(string &out, const char *name, const char *help, double value) {
+        char line[256];
+        out.append(line, snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %.17g\n",
+                                  name, help, name, name, value));
+    }
+};
+
+// Records the time from construction to the end of the scope
+class MetricTimer {
+    MetricOp op;
+    chrono::steady_clock::time_point start;
+    MetricTimer(const MetricTimer&);
+    MetricTimer& operator=(const MetricTimer&);
+public:
+    explicit MetricTimer(MetricOp o) : op(o), start(chrono::steady_clock::now()) {}
+    ~MetricTimer() {
+        Metrics::global().record(op, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+                                         chrono::steady_clock::now() - start).count());
+    }
+};
+
+#if LMS_METRICS
+#define LMS_TIME(op) MetricTimer lmsMetricTimer_(op)
+#define LMS_FAIL(op) Metrics::global().fail(op)
+#else
+#define LMS_TIME(op) do {} while (0)
+#define LMS_FAIL(op) do {} while (0)
+#endif
+
+// ---------- periodic dump ----------
+// Calls fn every interval on its own thread until destroyed.
+class MetricsDumper {
+    function<void()> fn;
+    chrono::milliseconds interval;
+    bool stopping;
+    mutex lock;
+    condition_variable wake;
+    thread worker;
+
+    MetricsDumper(const MetricsDumper&);
+    MetricsDumper& operator=(const MetricsDumper&);
+
+    void run() {
+        unique_lock<mutex> g(lock);
+        while (!stopping) {
+            if (wake.wait_for(g, interval, [this] { return stopping; })) break;
+            g.unlock();
+            fn();
+            g.lock();
+        }
+    }
+
+public:
+    MetricsDumper(function<void()> f, int seconds)
+            : fn(f), interval(seconds * 1000), stopping(false) {
+        worker = thread(&MetricsDumper::run, this);
+    }
+
+    ~MetricsDumper() {
+        {
+            lock_guard<mutex> g(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+};
+
+// Writes text to path through a temp file and rename, so a scraper never
+// sees half a file.
+inline bool writeMetricsFile(const string &path, const string &text) {
+    string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (f == NULL) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = (fclose(f) == 0) && ok;
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    else remove(tmp.c_str());
+    return ok;
+}
+
+#endif // METRICS_H
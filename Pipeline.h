@@ -0,0 +1,208 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "Library.h"
+#include <atomic>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// ========================= SINGLE-WRITER COMMAND PIPELINE =========================
+// One writer thread owns the Library and applies commands one after another;
+// any number of client threads submit commands and get a future back. No
+// lock is taken on the catalog, the books or the shared state: only the
+// writer ever touches them.
+//
+// Submission goes through a lock-free multi-producer / single-consumer queue
+// (D. Vyukov's intrusive MPSC list: one atomic exchange per push, no CAS
+// loop). The writer drains up to maxBatch commands at a time inside one
+// journal batch, so a whole batch costs one fsync, and fulfils the futures
+// only after that commit.
+//
+// Ordering: commands run in the order their pushes were linked, which keeps
+// each client's own order, so students join a book's waiting queue in the
+// order their ISSUE commands were submitted.
+
+struct PipelineCommand {
+    atomic<PipelineCommand*> next;
+
+    PipelineCommand() : next(NULL) {}
+    virtual ~PipelineCommand() {}
+    virtual void apply(Library &lib) = 0;     // on the writer thread
+    virtual void publish() = 0;               // after the batch is committed
+};
+
+template <class R, class F>
+struct PipelineTask : PipelineCommand {
+    F fn;
+    R value;
+    promise<R> result;
+
+    explicit PipelineTask(F f) : fn(f), value() {}
+    void apply(Library &lib) { value = fn(lib); }
+    void publish() { result.set_value(value); }
+};
+
+// ---------- LOCK-FREE MPSC QUEUE ----------
+class CommandQueue {
+    struct Stub : PipelineCommand {
+        void apply(Library &) {}
+        void publish() {}
+    };
+
+    Stub stub;
+    atomic<PipelineCommand*> head;      // producers push here
+    PipelineCommand *tail;              // consumer pops here
+
+    CommandQueue(const CommandQueue&);
+    CommandQueue& operator=(const CommandQueue&);
+
+    void pushNode(PipelineCommand *node) {
+        node->next.store(NULL, memory_order_relaxed);
+        PipelineCommand *prev = head.exchange(node, memory_order_acq_rel);
+        prev->next.store(node, memory_order_release);
+    }
+
+public:
+    CommandQueue() : head(&stub), tail(&stub) {}
+
+    // Any thread
+    void push(PipelineCommand *cmd) {
+        pushNode(cmd);
+    }
+
+    // Writer thread only. NULL if empty, or if a push is halfway done (the
+    // command shows up on a later pop).
+    PipelineCommand* pop() {
+        PipelineCommand *t = tail;
+        PipelineCommand *next = t->next.load(memory_order_acquire);
+        if (t == &stub) {
+            if (next == NULL) return NULL;
+            tail = next;
+            t = next;
+            next = next->next.load(memory_order_acquire);
+        }
+        if (next != NULL) {
+            tail = next;
+            return t;
+        }
+        if (t != head.load(memory_order_acquire)) return NULL;
+        pushNode(&stub);
+        next = t->next.load(memory_order_acquire);
+        if (next != NULL) {
+            tail = next;
+            return t;
+        }
+        return NULL;
+    }
+};
+
+// ---------- WRITER ----------
+class CommandPipeline {
+    Library &lib;
+    CommandQueue queue;
+    size_t maxBatch;
+    atomic<bool> stopping;
+    atomic<bool> idle;              // writer is (about to be) asleep
+    atomic<long long> submitted;
+    mutex wakeLock;
+    condition_variable wake;
+    thread writer;
+    atomic<long long> applied;
+    atomic<long long> batches;
+
+    CommandPipeline(const CommandPipeline&);
+    CommandPipeline& operator=(const CommandPipeline&);
+
+    void run() {
+        vector<PipelineCommand*> batch;
+        batch.reserve(maxBatch);
+        while (true) {
+            PipelineCommand *cmd;
+            while (batch.size() < maxBatch && (cmd = queue.pop()) != NULL) {
+                if (batch.empty()) lib.beginBatch();
+                cmd->apply(lib);
+                batch.push_back(cmd);
+            }
+            if (!batch.empty()) {
+                lib.endBatch();
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    batch[i]->publish();
+                    delete batch[i];
+                }
+                applied += (long long)batch.size();
+                ++batches;
+                batch.clear();
+                continue;
+            }
+            if (stopping && applied == submitted.load()) break;
+
+            // nothing to do: sleep until a submit wakes us (or a pop that
+            // raced with a half-done push can be retried)
+            unique_lock<mutex> g(wakeLock);
+            idle.store(true);
+            if (applied == submitted.load() && !stopping) {
+                wake.wait_for(g, chrono::milliseconds(1));
+            }
+            idle.store(false);
+        }
+    }
+
+public:
+    explicit CommandPipeline(Library &library, size_t batchLimit = 256)
+            : lib(library), maxBatch(batchLimit), stopping(false), idle(false),
+              submitted(0), applied(0), batches(0) {
+        writer = thread(&CommandPipeline::run, this);
+    }
+
+    // Applies everything already submitted, then stops the writer.
+    ~CommandPipeline() {
+        stopping = true;
+        {
+            lock_guard<mutex> g(wakeLock);
+            wake.notify_one();
+        }
+        writer.join();
+    }
+
+    // Runs fn(Library&) on the writer thread; any thread may call this.
+    template <class F>
+    auto submit(F fn) -> future<decltype(fn(lib))> {
+        typedef decltype(fn(lib)) R;
+        PipelineTask<R, F> *task = new PipelineTask<R, F>(fn);
+        future<R> f = task->result.get_future();
+        submitted.fetch_add(1);
+        queue.push(task);
+        if (idle.load()) {
+            lock_guard<mutex> g(wakeLock);
+            wake.notify_one();
+        }
+        return f;
+    }
+
+    future<LibStatus> addBook(int id, const string &title, const string &author, int total) {
+        return submit([=](Library &l) { return l.addBook(id, title, author, total); });
+    }
+
+    future<LibStatus> deleteBook(int id) {
+        return submit([=](Library &l) { return l.deleteBook(id); });
+    }
+
+    future<IssueResult> issue(int bookId, const string &studentId, const Date &date) {
+        return submit([=](Library &l) { return l.issue(bookId, studentId, date); });
+    }
+
+    future<ReturnResult> returnBook(int bookId, const string &studentId, const Date &date) {
+        return submit([=](Library &l) { return l.returnBook(bookId, studentId, date); });
+    }
+
+    // Writer-side counters; exact once the pipeline is drained
+    long long commandsApplied() const { return applied; }
+    long long batchCount() const { return batches; }
+};
+
+#endif // PIPELINE_H
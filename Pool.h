@@ -0,0 +1,137 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+using namespace std;
+
+// ========================= NODE POOL (SLAB ALLOCATOR) =========================
+// Hands out fixed-size slots for one node type from large slabs and keeps
+// freed slots on a free list, so steady-state create/destroy never touches
+// the heap. Slabs double in size (up to maxSlab) as the pool grows.
+
+struct PoolStats {
+    size_t slabs;           // slabs currently held
+    size_t capacity;        // slots in those slabs
+    size_t live;            // objects currently alive
+    size_t heapCalls;       // slab allocations made so far
+    size_t creates;         // create() calls so far
+    size_t destroys;        // destroy() calls so far
+    size_t bytes;           // memory held in slabs
+};
+
+template <class T>
+class NodePool {
+    union Slot {
+        Slot *nextFree;
+        typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    struct Slab {
+        Slot *slots;
+        size_t count;
+    };
+
+    static const size_t firstSlab = 64;
+    static const size_t maxSlab = 65536;
+
+    vector<Slab> slabs;
+    Slot *freeList;
+    size_t nextSlab;
+    PoolStats stats;
+
+    void grow() {
+        Slab s;
+        s.count = nextSlab;
+        s.slots = static_cast<Slot*>(::operator new(sizeof(Slot) * s.count));
+        for (size_t i = s.count; i > 0; --i) {
+            s.slots[i-1].nextFree = freeList;
+            freeList = &s.slots[i-1];
+        }
+        slabs.push_back(s);
+        if (nextSlab < maxSlab) nextSlab *= 2;
+        stats.slabs++;
+        stats.capacity += s.count;
+        stats.heapCalls++;
+        stats.bytes += sizeof(Slot) * s.count;
+    }
+
+    static bool slabBefore(const Slab &a, const Slab &b) {
+        return a.slots < b.slots;
+    }
+
+    // Runs the destructor of every live object, slab by slab. Free slots are
+    // found by marking the free list first, so nothing is pointer-chased.
+    void destroyLive() {
+        if (stats.live == 0) return;
+        vector<Slab> order(slabs);
+        sort(order.begin(), order.end(), slabBefore);
+        vector<vector<bool> > isFree(order.size());
+        for (size_t i = 0; i < order.size(); ++i) isFree[i].assign(order[i].count, false);
+        for (Slot *f = freeList; f != NULL; f = f->nextFree) {
+            size_t lo = 0, hi = order.size();
+            while (hi - lo > 1) {
+                size_t mid = (lo + hi) / 2;
+                if (order[mid].slots <= f) lo = mid; else hi = mid;
+            }
+            isFree[lo][f - order[lo].slots] = true;
+        }
+        for (size_t i = 0; i < order.size(); ++i) {
+            for (size_t j = 0; j < order[i].count; ++j) {
+                if (!isFree[i][j]) reinterpret_cast<T*>(&order[i].slots[j].storage)->~T();
+            }
+        }
+    }
+
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+public:
+    NodePool() : freeList(NULL), nextSlab(firstSlab) {
+        PoolStats zero = {0, 0, 0, 0, 0, 0, 0};
+        stats = zero;
+    }
+
+    ~NodePool() {
+        releaseAll();
+    }
+
+    template <class... Args>
+    T* create(Args&&... args) {
+        if (freeList == NULL) grow();
+        Slot *s = freeList;
+        freeList = s->nextFree;
+        T *obj = new (&s->storage) T(std::forward<Args>(args)...);
+        stats.live++;
+        stats.creates++;
+        return obj;
+    }
+
+    void destroy(T *obj) {
+        if (obj == NULL) return;
+        obj->~T();
+        Slot *s = reinterpret_cast<Slot*>(obj);
+        s->nextFree = freeList;
+        freeList = s;
+        stats.live--;
+        stats.destroys++;
+    }
+
+    // Drops every object at once and gives all slabs back to the heap.
+    void releaseAll() {
+        if (!is_trivially_destructible<T>::value) destroyLive();
+        for (size_t i = 0; i < slabs.size(); ++i) ::operator delete(slabs[i].slots);
+        slabs.clear();
+        freeList = NULL;
+        nextSlab = firstSlab;
+        stats.slabs = stats.capacity = stats.live = stats.bytes = 0;
+    }
+
+    const PoolStats& statistics() const { return stats; }
+};
+
+#endif // POOL_H
@@ -0,0 +1,223 @@
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// ========================= PREFIX INDEX (COMPRESSED TRIE) =========================
+// Radix tree over case-folded keys (ASCII letters lower-cased, everything
+// else as is). Each edge holds a run of bytes; a node where a key ends keeps
+// the ids of the books with that key. Every inner node other than the root
+// branches or ends a key, so the subtree holding N keys has fewer than 2N
+// nodes and the first N completions of a prefix cost O(prefix + N) node
+// visits. Completions come out in key order.
+
+struct PrefixMatch {
+    int id;             // lowest id with this key (its text is the completion)
+    int books;          // how many books share the key
+};
+
+class PrefixIndex {
+    struct Node {
+        string label;               // bytes on the edge into this node
+        vector<Node*> children;     // ordered by the first byte of their label
+        vector<int> ids;            // books whose key ends here, ascending
+    };
+
+    Node root;
+    size_t keys;                    // distinct keys
+    size_t nodes;                   // not counting the root
+
+    PrefixIndex(const PrefixIndex&);
+    PrefixIndex& operator=(const PrefixIndex&);
+
+    static char fold(char c) {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    static string foldKey(string_view s) {
+        string k(s);
+        for (size_t i = 0; i < k.size(); ++i) k[i] = fold(k[i]);
+        return k;
+    }
+
+    // Slot of the child whose label starts with c (or where it would go)
+    static size_t childSlot(const Node *n, char c) {
+        size_t lo = 0, hi = n->children.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if ((unsigned char)n->children[mid]->label[0] < (unsigned char)c) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    static Node* childFor(const Node *n, char c) {
+        size_t i = childSlot(n, c);
+        if (i < n->children.size() && n->children[i]->label[0] == c) return n->children[i];
+        return NULL;
+    }
+
+    static void destroy(Node *n) {
+        for (size_t i = 0; i < n->children.size(); ++i) {
+            destroy(n->children[i]);
+            delete n->children[i];
+        }
+        n->children.clear();
+    }
+
+    // A node that no longer ends a key and has one child absorbs it
+    void mergeWithChild(Node *n) {
+        Node *c = n->children[0];
+        n->label += c->label;
+        n->ids.swap(c->ids);
+        n->children.swap(c->children);
+        delete c;
+        --nodes;
+    }
+
+    static size_t nodeBytes(const Node *n) {
+        size_t bytes = sizeof(Node) + n->children.capacity() * sizeof(Node*) +
+                       n->ids.capacity() * sizeof(int);
+        if (n->label.capacity() > 15) bytes += n->label.capacity() + 1;     // heap buffer
+        for (size_t i = 0; i < n->children.size(); ++i) bytes += nodeBytes(n->children[i]);
+        return bytes;
+    }
+
+public:
+    PrefixIndex() : keys(0), nodes(0) {}
+
+    ~PrefixIndex() {
+        destroy(&root);
+    }
+
+    size_t keyCount() const { return keys; }
+    size_t nodeCount() const { return nodes; }
+
+    void clear() {
+        destroy(&root);
+        root.ids.clear();
+        keys = nodes = 0;
+    }
+
+    void add(int id, string_view text) {
+        string key = foldKey(text);
+        Node *n = &root;
+        size_t i = 0;
+        while (i < key.size()) {
+            size_t slot = childSlot(n, key[i]);
+            if (slot == n->children.size() || n->children[slot]->label[0] != key[i]) {
+                Node *leaf = new Node;
+                leaf->label = key.substr(i);
+                n->children.insert(n->children.begin() + slot, leaf);
+                n = leaf;
+                ++nodes;
+                i = key.size();
+                break;
+            }
+            Node *c = n->children[slot];
+            size_t common = 1;
+            while (common < c->label.size() && i + common < key.size() &&
+                   c->label[common] == key[i + common]) {
+                ++common;
+            }
+            if (common < c->label.size()) {
+                // split the edge: mid takes the shared bytes, c keeps the rest
+                Node *mid = new Node;
+                mid->label = c->label.substr(0, common);
+                c->label.erase(0, common);
+                mid->children.push_back(c);
+                n->children[slot] = mid;
+                ++nodes;
+                c = mid;
+            }
+            n = c;
+            i += common;
+        }
+        if (n->ids.empty()) ++keys;
+        vector<int>::iterator it = lower_bound(n->ids.begin(), n->ids.end(), id);
+        if (it == n->ids.end() || *it != id) n->ids.insert(it, id);
+    }
+
+    void remove(int id, string_view text) {
+        string key = foldKey(text);
+        vector<Node*> path;         // root first
+        vector<size_t> slots;       // slot of path[i+1] in path[i]
+        Node *n = &root;
+        path.push_back(n);
+        size_t i = 0;
+        while (i < key.size()) {
+            size_t slot = childSlot(n, key[i]);
+            if (slot == n->children.size()) return;
+            Node *c = n->children[slot];
+            if (key.compare(i, c->label.size(), c->label) != 0) return;
+            i += c->label.size();
+            slots.push_back(slot);
+            path.push_back(c);
+            n = c;
+        }
+        vector<int>::iterator it = lower_bound(n->ids.begin(), n->ids.end(), id);
+        if (it == n->ids.end() || *it != id) return;
+        n->ids.erase(it);
+        if (!n->ids.empty()) return;
+        --keys;
+        if (n == &root) return;
+
+        if (n->children.size() == 1) {
+            mergeWithChild(n);
+            return;
+        }
+        if (!n->children.empty()) return;
+        Node *parent = path[path.size() - 2];
+        parent->children.erase(parent->children.begin() + slots.back());
+        delete n;
+        --nodes;
+        if (parent != &root && parent->ids.empty() && parent->children.size() == 1) {
+            mergeWithChild(parent);
+        }
+    }
+
+    // Up to n keys starting with prefix (case-folded), in key order.
+    void complete(const string &prefix, size_t n, vector<PrefixMatch> &out) const {
+        out.clear();
+        if (n == 0) return;
+        string p = foldKey(prefix);
+        const Node *cur = &root;
+        size_t i = 0;
+        while (i < p.size()) {
+            const Node *c = childFor(cur, p[i]);
+            if (c == NULL) return;
+            size_t len = min(c->label.size(), p.size() - i);
+            if (p.compare(i, len, c->label, 0, len) != 0) return;
+            i += len;
+            cur = c;
+        }
+
+        // pre-order walk: a key comes before the longer keys below it
+        vector<const Node*> stack;
+        stack.push_back(cur);
+        while (!stack.empty() && out.size() < n) {
+            const Node *node = stack.back();
+            stack.pop_back();
+            if (!node->ids.empty()) {
+                PrefixMatch m;
+                m.id = node->ids[0];
+                m.books = (int)node->ids.size();
+                out.push_back(m);
+            }
+            for (size_t c = node->children.size(); c > 0; --c) {
+                stack.push_back(node->children[c - 1]);
+            }
+        }
+    }
+
+    // Bytes held by the nodes, their labels, child arrays and id lists
+    size_t memoryBytes() const {
+        return nodeBytes(&root);
+    }
+};
+
+#endif // PREFIX_INDEX_H
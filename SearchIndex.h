@@ -0,0 +1,430 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+using namespace std;
+
+// ========================= SUBSTRING INDEX (3-GRAM POSTINGS) =========================
+// Every 3-byte substring of a text maps to the list of books whose text
+// contains it. A 3-byte query is answered by one posting list; a longer one
+// intersects the lists of its 3-grams and the caller confirms each candidate
+// with string::find. Queries under 3 bytes are not indexed (their lists
+// would hold most of the catalog); the caller scans for them. Matching is
+// byte-exact and case-sensitive, the same as string::find.
+//
+// Books get slot numbers in the order they are added, so posting lists only
+// ever grow at the back. A removed book's slot is marked dead and skipped;
+// the lists are swept once dead slots outnumber live ones.
+
+class SubstringIndex {
+    unordered_map<unsigned int, vector<unsigned int> > postings;   // slots, ascending
+    unordered_map<int, unsigned int> slotOf;
+    vector<int> slotId;                 // DEAD_SLOT once removed
+    size_t deadSlots;
+
+    enum { DEAD_SLOT = -1 };
+    enum { MIN_SWEEP = 1024 };          // dead slots tolerated regardless
+
+    static unsigned int gramKey(const char *p) {
+        return (unsigned int)(unsigned char)p[0] << 16 |
+               (unsigned int)(unsigned char)p[1] << 8 |
+               (unsigned int)(unsigned char)p[2];
+    }
+
+    static void gramsOf(string_view text, vector<unsigned int> &keys) {
+        keys.clear();
+        for (size_t i = 0; i + 3 <= text.size(); ++i) keys.push_back(gramKey(text.data() + i));
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    }
+
+    const vector<unsigned int>* listFor(unsigned int key) const {
+        unordered_map<unsigned int, vector<unsigned int> >::const_iterator it = postings.find(key);
+        return it == postings.end() ? NULL : &it->second;
+    }
+
+    // Drops dead slots from every list and numbers the live ones afresh (in
+    // the same order, so lists stay ascending); one pass over the postings.
+    void sweep() {
+        const unsigned int gone = (unsigned int)-1;
+        vector<unsigned int> renumber(slotId.size(), gone);
+        size_t live = 0;
+        for (size_t s = 0; s < slotId.size(); ++s) {
+            if (slotId[s] == DEAD_SLOT) continue;
+            renumber[s] = (unsigned int)live;
+            slotId[live] = slotId[s];
+            slotOf[slotId[live]] = (unsigned int)live;
+            ++live;
+        }
+        unordered_map<unsigned int, vector<unsigned int> >::iterator it = postings.begin();
+        while (it != postings.end()) {
+            vector<unsigned int> &v = it->second;
+            size_t keep = 0;
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (renumber[v[i]] != gone) v[keep++] = renumber[v[i]];
+            }
+            v.resize(keep);
+            if (v.empty()) {
+                it = postings.erase(it);
+            } else {
+                v.shrink_to_fit();
+                ++it;
+            }
+        }
+        slotId.resize(live);
+        deadSlots = 0;
+    }
+
+public:
+    SubstringIndex() : deadSlots(0) {}
+
+    // Queries the index can answer; shorter ones need a scan
+    static bool indexable(const string &q) {
+        return q.size() >= 3;
+    }
+
+    void add(int id, string_view text) {
+        if (slotOf.count(id)) return;
+        unsigned int slot = (unsigned int)slotId.size();
+        slotId.push_back(id);
+        slotOf[id] = slot;
+        vector<unsigned int> keys;
+        gramsOf(text, keys);
+        for (size_t i = 0; i < keys.size(); ++i) postings[keys[i]].push_back(slot);
+    }
+
+    void remove(int id, string_view) {
+        unordered_map<int, unsigned int>::iterator it = slotOf.find(id);
+        if (it == slotOf.end()) return;
+        slotId[it->second] = DEAD_SLOT;
+        slotOf.erase(it);
+        if (++deadSlots > MIN_SWEEP && deadSlots > slotOf.size()) sweep();
+    }
+
+    void clear() {
+        postings.clear();
+        slotOf.clear();
+        slotId.clear();
+        deadSlots = 0;
+    }
+
+    // Fills out with ids (ascending) that may contain q, which must be
+    // indexable. Returns true when the result is exact, false when each
+    // candidate still has to be verified.
+    bool candidates(const string &q, vector<int> &out) const {
+        out.clear();
+        size_t n = q.size();
+        vector<const vector<unsigned int>*> lists;
+        for (size_t i = 0; i + 3 <= n; ++i) {
+            const vector<unsigned int> *v = listFor(gramKey(q.data() + i));
+            if (v == NULL) return true;     // some 3-gram never occurs
+            lists.push_back(v);
+        }
+        sort(lists.begin(), lists.end(), shorterList);
+        lists.erase(unique(lists.begin(), lists.end()), lists.end());
+
+        vector<unsigned int> slots(*lists[0]);
+        for (size_t l = 1; l < lists.size() && !slots.empty(); ++l) {
+            const vector<unsigned int> &v = *lists[l];
+            size_t keep = 0;
+            vector<unsigned int>::const_iterator from = v.begin();
+            for (size_t i = 0; i < slots.size(); ++i) {
+                from = lower_bound(from, v.end(), slots[i]);
+                if (from == v.end()) break;
+                if (*from == slots[i]) slots[keep++] = slots[i];
+            }
+            slots.resize(keep);
+        }
+        out.reserve(slots.size());
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slotId[slots[i]] != DEAD_SLOT) out.push_back(slotId[slots[i]]);
+        }
+        sort(out.begin(), out.end());      // slots follow add order, not ids
+        return n == 3;
+    }
+
+    static bool shorterList(const vector<unsigned int> *a, const vector<unsigned int> *b) {
+        return a->size() < b->size() || (a->size() == b->size() && a < b);
+    }
+
+    // Bytes held by the posting lists, slot tables and hash tables (approximate)
+    size_t memoryBytes() const {
+        size_t bytes = postings.bucket_count() * sizeof(void*) +
+                       slotId.capacity() * sizeof(int) +
+                       slotOf.size() * (sizeof(int) + sizeof(unsigned int) + 2 * sizeof(void*)) +
+                       slotOf.bucket_count() * sizeof(void*);
+        for (unordered_map<unsigned int, vector<unsigned int> >::const_iterator it = postings.begin();
+             it != postings.end(); ++it) {
+            bytes += sizeof(*it) + sizeof(void*) + it->second.capacity() * sizeof(unsigned int);
+        }
+        return bytes;
+    }
+};
+
+// ========================= FUZZY INDEX (TRIGRAMS OF NORMALIZED WORDS) =========================
+// Typo-tolerant lookup. Text is case-folded (ASCII) and split into words at
+// anything that is not a letter or digit (bytes >= 0x80 count as letters);
+// each word w contributes the trigrams of "  w ". A query is scored by how
+// many of its trigrams a text shares:
+//
+//   similarity = 0.8 * shared / queryGrams + 0.2 * 2 * shared / (queryGrams + textGrams)
+//
+// so a misspelt word inside a longer title still ranks high, and the closer
+// text in length wins a tie. Texts sharing under a third of the query's
+// trigrams are not reported.
+//
+// Books get dense slot numbers so a query can count shared trigrams in a
+// flat array. The arrays are kept between queries and stamped with a query
+// number instead of being cleared, so a query costs what it reads, not the
+// catalog size. Only the rarest trigrams of the query produce candidates (any
+// text over the threshold must contain one of them); the frequent ones are
+// checked against the candidates only.
+
+struct FuzzyHit {
+    int id;
+    double score;       // 0..1
+};
+
+inline bool fuzzyHitBefore(const FuzzyHit &a, const FuzzyHit &b) {
+    return a.score > b.score || (a.score == b.score && a.id < b.id);
+}
+
+class FuzzyIndex {
+    unordered_map<unsigned int, vector<unsigned int> > postings;   // slots, ascending
+    unordered_map<int, unsigned int> slotOf;
+    vector<int> slotId;
+    vector<unsigned short> slotGrams;   // distinct trigrams; 0 = free slot
+    vector<unsigned int> freeSlots;
+
+    // Per-query counters; shared[s] counts only while stamp[s] == query
+    struct Scratch {
+        vector<unsigned int> stamp;
+        vector<unsigned short> shared;
+        unsigned int query;
+    };
+    mutable mutex scratchLock;
+    mutable vector<Scratch*> spareScratch;  // one per search running at once
+
+    FuzzyIndex(const FuzzyIndex&);
+    FuzzyIndex& operator=(const FuzzyIndex&);
+
+    Scratch* takeScratch() const {
+        Scratch *sc = NULL;
+        {
+            lock_guard<mutex> g(scratchLock);
+            if (!spareScratch.empty()) {
+                sc = spareScratch.back();
+                spareScratch.pop_back();
+            }
+        }
+        if (sc == NULL) {
+            sc = new Scratch;
+            sc->query = 0;
+        }
+        if (sc->stamp.size() < slotId.size()) {
+            sc->stamp.resize(slotId.size(), 0);
+            sc->shared.resize(slotId.size(), 0);
+        }
+        if (++sc->query == 0) {             // wrapped: old stamps could match
+            fill(sc->stamp.begin(), sc->stamp.end(), 0);
+            sc->query = 1;
+        }
+        return sc;
+    }
+
+    void giveBack(Scratch *sc) const {
+        lock_guard<mutex> g(scratchLock);
+        spareScratch.push_back(sc);
+    }
+
+    static unsigned char fold(unsigned char c) {
+        if (c >= 'A' && c <= 'Z') return (unsigned char)(c - 'A' + 'a');
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) return c;
+        return 0;                       // separator
+    }
+
+    static void gramsOf(string_view text, vector<unsigned int> &keys) {
+        keys.clear();
+        unsigned int window = ((unsigned int)' ' << 8) | ' ';
+        bool inWord = false;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            unsigned char c = i < text.size() ? fold((unsigned char)text[i]) : 0;
+            if (c == 0) {
+                if (inWord) keys.push_back(((window << 8) | ' ') & 0xFFFFFF);
+                inWord = false;
+                window = ((unsigned int)' ' << 8) | ' ';
+                continue;
+            }
+            window = ((window << 8) | c) & 0xFFFFFF;
+            keys.push_back(window);
+            inWord = true;
+        }
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    }
+
+    static bool shorterList(const vector<unsigned int> *a, const vector<unsigned int> *b) {
+        return a->size() < b->size();
+    }
+
+public:
+    FuzzyIndex() {}
+
+    ~FuzzyIndex() {
+        for (size_t i = 0; i < spareScratch.size(); ++i) delete spareScratch[i];
+    }
+
+    size_t size() const { return slotOf.size(); }
+
+    void add(int id, string_view text) {
+        if (slotOf.count(id)) return;
+        vector<unsigned int> keys;
+        gramsOf(text, keys);
+        unsigned int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = (unsigned int)slotId.size();
+            slotId.push_back(0);
+            slotGrams.push_back(0);
+        }
+        slotId[slot] = id;
+        slotGrams[slot] = (unsigned short)(keys.size() < 65535 ? keys.size() : 65535);
+        if (slotGrams[slot] == 0) slotGrams[slot] = 1;      // textless, but taken
+        slotOf[id] = slot;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            vector<unsigned int> &v = postings[keys[i]];
+            if (v.empty() || v.back() < slot) v.push_back(slot);
+            else v.insert(lower_bound(v.begin(), v.end(), slot), slot);
+        }
+    }
+
+    void remove(int id, string_view text) {
+        unordered_map<int, unsigned int>::iterator sit = slotOf.find(id);
+        if (sit == slotOf.end()) return;
+        unsigned int slot = sit->second;
+        slotOf.erase(sit);
+        vector<unsigned int> keys;
+        gramsOf(text, keys);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            unordered_map<unsigned int, vector<unsigned int> >::iterator pit = postings.find(keys[i]);
+            if (pit == postings.end()) continue;
+            vector<unsigned int> &v = pit->second;
+            vector<unsigned int>::iterator it = lower_bound(v.begin(), v.end(), slot);
+            if (it != v.end() && *it == slot) v.erase(it);
+            if (v.empty()) postings.erase(pit);
+        }
+        slotGrams[slot] = 0;
+        freeSlots.push_back(slot);
+    }
+
+    void clear() {
+        postings.clear();
+        slotOf.clear();
+        slotId.clear();
+        slotGrams.clear();
+        freeSlots.clear();
+    }
+
+    // Up to k best matches for q, best first (ties by id). Safe to call from
+    // several threads at once: each search takes a scratch of its own.
+    vector<FuzzyHit> search(const string &q, size_t k) const {
+        vector<FuzzyHit> hits;
+        vector<unsigned int> keys;
+        gramsOf(q, keys);
+        if (keys.empty() || k == 0) return hits;
+        size_t qn = keys.size();
+        size_t minShared = (qn + 2) / 3;
+
+        vector<const vector<unsigned int>*> lists;
+        for (size_t i = 0; i < qn; ++i) {
+            unordered_map<unsigned int, vector<unsigned int> >::const_iterator it = postings.find(keys[i]);
+            if (it != postings.end()) lists.push_back(&it->second);
+        }
+        if (lists.size() < minShared) return hits;
+        sort(lists.begin(), lists.end(), shorterList);
+
+        // Candidates: slots in one of the rarest (qn - minShared + 1) lists
+        Scratch *sc = takeScratch();
+        const unsigned int query = sc->query;
+        unsigned int *stamp = sc->stamp.data();
+        unsigned short *shared = sc->shared.data();
+        vector<unsigned int> cand;
+        size_t probe = qn - minShared + 1;
+        if (probe > lists.size()) probe = lists.size();
+        for (size_t l = 0; l < probe; ++l) {
+            const vector<unsigned int> &v = *lists[l];
+            for (size_t i = 0; i < v.size(); ++i) {
+                unsigned int slot = v[i];
+                if (stamp[slot] != query) {
+                    stamp[slot] = query;
+                    shared[slot] = 0;
+                    cand.push_back(slot);
+                }
+                ++shared[slot];
+            }
+        }
+        // The rest only add to existing candidates: binary search per
+        // candidate when there are few, one pass over the list otherwise
+        for (size_t l = probe; l < lists.size(); ++l) {
+            const vector<unsigned int> &v = *lists[l];
+            if (cand.size() * 16 < v.size()) {
+                for (size_t c = 0; c < cand.size(); ++c) {
+                    if (binary_search(v.begin(), v.end(), cand[c])) ++shared[cand[c]];
+                }
+            } else {
+                for (size_t i = 0; i < v.size(); ++i) {
+                    if (stamp[v[i]] == query) ++shared[v[i]];
+                }
+            }
+        }
+
+        for (size_t c = 0; c < cand.size(); ++c) {
+            unsigned int slot = cand[c];
+            if (shared[slot] < minShared) continue;
+            double s = shared[slot];
+            FuzzyHit h;
+            h.id = slotId[slot];
+            h.score = 0.8 * s / qn + 0.2 * 2.0 * s / (qn + slotGrams[slot]);
+            hits.push_back(h);
+        }
+        giveBack(sc);
+        if (hits.size() > k) {
+            partial_sort(hits.begin(), hits.begin() + k, hits.end(), fuzzyHitBefore);
+            hits.resize(k);
+        } else {
+            sort(hits.begin(), hits.end(), fuzzyHitBefore);
+        }
+        return hits;
+    }
+
+    // Bytes held by the postings, slot tables and id map (approximate)
+    size_t memoryBytes() const {
+        size_t bytes = slotId.capacity() * sizeof(int) +
+                       slotGrams.capacity() * sizeof(unsigned short) +
+                       freeSlots.capacity() * sizeof(unsigned int) +
+                       slotOf.size() * (sizeof(int) + sizeof(unsigned int) + 2 * sizeof(void*)) +
+                       slotOf.bucket_count() * sizeof(void*) +
+                       postings.bucket_count() * sizeof(void*);
+        {
+            lock_guard<mutex> g(scratchLock);
+            for (size_t i = 0; i < spareScratch.size(); ++i) {
+                bytes += spareScratch[i]->stamp.capacity() * sizeof(unsigned int) +
+                         spareScratch[i]->shared.capacity() * sizeof(unsigned short);
+            }
+        }
+        for (unordered_map<unsigned int, vector<unsigned int> >::const_iterator it = postings.begin();
+             it != postings.end(); ++it) {
+            bytes += sizeof(*it) + 2 * sizeof(void*) + it->second.capacity() * sizeof(unsigned int);
+        }
+        return bytes;
+    }
+};
+
+#endif // SEARCH_INDEX_H
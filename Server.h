@@ -0,0 +1,534 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "Library.h"
+#include "User.h"
+#include "Pipeline.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+using namespace std;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// ========================= MULTI-SESSION SERVER =========================
+// Serves many desks / kiosks at once over a Unix stream socket, one thread
+// per session. Each request is one line; each reply is a status line, then
+// any data lines, then a line holding just ".":
+//
+//   LOGIN user password                  OK ROLE
+//   FIND id                              OK 1, then id|title|author|total|avail|waiting
+//   TITLE text / AUTHOR text             OK n, then n book lines
+//   COMPLETE TITLE|AUTHOR prefix         OK n, then id|books|text for up to 10 completions
+//   RANGE fromId toId                    OK n, then the book lines with ids in [fromId, toId]
+//   LIST [fromId count]                  OK n, then n book lines, then NEXT id
+//                                        if the catalog goes on past this page
+//   ISSUE id dd mm yyyy [student]        OK ISSUED dd/mm/yyyy | OK QUEUED position
+//   RETURN id dd mm yyyy [student]       OK RETURNED daysLate fine [next dd/mm/yyyy]
+//   STUDENT [student]                    OK n, then LOAN|id|due and WAIT|id|position lines
+//   ADD id total title|author            OK
+//   DELETE id                            OK
+//   SAVE                                 OK
+//   METRICS                              OK n, then n lines of Prometheus text (staff)
+//   SHUTDOWN                             OK (admin; stops the server)
+//   QUIT
+//
+// Failures reply "ERR reason". Students may only issue, return and look up
+// their own books; the [student] argument is for librarians.
+//
+// Locking:
+//   catalogLock   shared for reads, issue and return; exclusive for add,
+//                 delete and save (they change the list and indexes)
+//   bookLocks     striped by book id; issue / return of one book
+//   book lines    FIND, TITLE, AUTHOR, RANGE and LIST read counts from one
+//                 Library::ReadSnapshot per request: no book lock, and the
+//                 reply shows the catalog as of a single moment
+//   Library state its own lock around pools, student entries and the due
+//                 index (Library::StateGuard), held only for the pointer work
+//   journal       group commit, so concurrent mutations share an fsync
+//
+// Pipeline mode (--pipeline): every mutation, and every save, is handed to
+// a CommandPipeline instead and applied by its one writer thread, which
+// commits the journal once per batch. The session waits for the reply. The
+// writer takes catalogLock as above, so reads are unchanged; book locks
+// are then never contended.
+
+class LibraryServer {
+    static const int STRIPES = 256;
+    static const unsigned SAVE_EVERY = 1024;    // mutations between save checks
+
+    Library &lib;
+    AuthSystem &auth;
+    string socketPath;
+    int listenFd;
+    atomic<bool> stopping;
+    atomic<unsigned> mutations;
+    bool pipelined;
+    CommandPipeline *pipeline;      // pipeline mode, while serving
+
+    shared_mutex catalogLock;
+    mutex bookLocks[STRIPES];
+    mutex authLock;
+
+    mutex sessionLock;
+    condition_variable sessionsDone;
+    set<int> sessionFds;
+
+    struct Session {
+        bool loggedIn;
+        User user;
+        Session() : loggedIn(false) {}
+    };
+
+    LibraryServer(const LibraryServer&);
+    LibraryServer& operator=(const LibraryServer&);
+
+    mutex& bookLock(int id) {
+        return bookLocks[(unsigned)id % STRIPES];
+    }
+
+    static const char* statusName(LibStatus s) {
+        switch (s) {
+            case LIB_OK:              return "OK";
+            case LIB_QUEUED:          return "QUEUED";
+            case LIB_NOT_FOUND:       return "NOT_FOUND";
+            case LIB_DUPLICATE_ID:    return "DUPLICATE_ID";
+            case LIB_INVALID_COPIES:  return "INVALID_COPIES";
+            case LIB_INVALID_DATE:    return "INVALID_DATE";
+            case LIB_ALREADY_ISSUED:  return "ALREADY_ISSUED";
+            case LIB_ALREADY_QUEUED:  return "ALREADY_QUEUED";
+            case LIB_NOT_ISSUED:      return "NOT_ISSUED";
+            default:                  return "ERROR";
+        }
+    }
+
+    static string dateText(const Date &d) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%02d/%02d/%04d", d.day, d.month, d.year);
+        return buf;
+    }
+
+    // Splits off the next space-separated word of line, starting at pos
+    static string nextWord(const string &line, size_t &pos) {
+        while (pos < line.size() && line[pos] == ' ') ++pos;
+        size_t start = pos;
+        while (pos < line.size() && line[pos] != ' ') ++pos;
+        return line.substr(start, pos - start);
+    }
+
+    static string rest(const string &line, size_t pos) {
+        while (pos < line.size() && line[pos] == ' ') ++pos;
+        return line.substr(pos);
+    }
+
+    static bool parseInt(const string &s, int &out) {
+        if (s.empty()) return false;
+        char *end = NULL;
+        long v = strtol(s.c_str(), &end, 10);
+        if (*end != '\0') return false;
+        out = (int)v;
+        return true;
+    }
+
+    // Catalog lock held (shared); false if the book is newer than snap.
+    static bool appendBook(string &out, const Library::ReadSnapshot &snap, const BookNode *b) {
+        int available, waiting;
+        if (!snap.counts(b, available, waiting)) return false;
+        b->appendFileLine(out, available);
+        char num[16];
+        out.append(num, snprintf(num, sizeof(num), "|%d\n", waiting));
+        return true;
+    }
+
+    void appendBooks(string &out, const vector<BookNode*> &books) {
+        Library::ReadSnapshot snap(lib);
+        string lines;
+        size_t n = 0;
+        for (size_t i = 0; i < books.size(); ++i) {
+            if (appendBook(lines, snap, books[i])) ++n;
+        }
+        char num[24];
+        out.append(num, snprintf(num, sizeof(num), "OK %zu\n", n));
+        out += lines;
+    }
+
+    // Whose loan an ISSUE / RETURN / STUDENT line is about; "" if not allowed
+    static string subject(const Session &s, const string &named) {
+        if (s.user.role == ROLE_STUDENT) {
+            return named.empty() || named == s.user.username ? s.user.username : "";
+        }
+        return named;
+    }
+
+    // Runs fn(lib) as one mutation: on the pipeline's writer in pipeline
+    // mode, else right here.
+    template <class F>
+    auto mutate(F fn) -> decltype(fn(lib)) {
+        if (pipeline == NULL) return fn(lib);
+        return pipeline->submit(fn).get();
+    }
+
+    bool save() {
+        return mutate([this](Library &l) {
+            unique_lock<shared_mutex> g(catalogLock);
+            return l.saveToFile();
+        });
+    }
+
+    // Every SAVE_EVERY mutations, fold a grown journal into a snapshot
+    void noteMutation() {
+        if (++mutations % SAVE_EVERY != 0) return;
+        save();
+    }
+
+    string issueOrReturn(const Session &s, const string &cmd, const string &line, size_t pos) {
+        int id = 0;
+        Date d;
+        if (!parseInt(nextWord(line, pos), id) || !parseInt(nextWord(line, pos), d.day) ||
+            !parseInt(nextWord(line, pos), d.month) || !parseInt(nextWord(line, pos), d.year)) {
+            return "ERR USAGE " + cmd + " id dd mm yyyy [student]\n";
+        }
+        string student = subject(s, nextWord(line, pos));
+        if (student.empty()) {
+            return s.user.role == ROLE_STUDENT ? "ERR FORBIDDEN\n"
+                                               : "ERR USAGE " + cmd + " id dd mm yyyy student\n";
+        }
+
+        string out = mutate([&](Library &l) {
+            string reply;
+            shared_lock<shared_mutex> cat(catalogLock);
+            lock_guard<mutex> book(bookLock(id));
+            if (cmd == "ISSUE") {
+                IssueResult r = l.issue(id, student, d);
+                if (r.status == LIB_OK) reply = "OK ISSUED " + dateText(r.dueDate) + "\n";
+                else if (r.status == LIB_QUEUED) reply = "OK QUEUED " + to_string(r.queuePosition) + "\n";
+                else reply = string("ERR ") + statusName(r.status) + "\n";
+            } else {
+                ReturnResult r = l.returnBook(id, student, d);
+                if (r.status != LIB_OK) {
+                    reply = string("ERR ") + statusName(r.status) + "\n";
+                } else {
+                    reply = "OK RETURNED " + to_string(r.daysLate) + " " + to_string(r.fine);
+                    if (!r.nextStudent.empty()) {
+                        reply += " " + r.nextStudent + " " + dateText(r.nextDueDate);
+                    }
+                    reply += "\n";
+                }
+            }
+            return reply;
+        });
+        if (out[0] == 'O') noteMutation();
+        return out;
+    }
+
+    string studentStatus(const Session &s, const string &named) {
+        string student = subject(s, named);
+        if (student.empty()) {
+            return s.user.role == ROLE_STUDENT ? "ERR FORBIDDEN\n" : "ERR USAGE STUDENT student\n";
+        }
+        shared_lock<shared_mutex> cat(catalogLock);
+        Library::StateGuard guard(lib);
+        const StudentEntry *st = lib.findStudent(student);
+        string out = "OK " + to_string(st == NULL ? 0 : st->loanCount + st->waitCount) + "\n";
+        if (st == NULL) return out;
+        for (IssuedRecord *ir = st->loans; ir != NULL; ir = ir->studentNext) {
+            out += "LOAN|" + to_string(ir->book->id) + "|" + dateText(ir->dueDate()) + "\n";
+        }
+        for (WaitNode *wn = st->waits; wn != NULL; wn = wn->studentNext) {
+            out += "WAIT|" + to_string(wn->book->id) + "|" +
+                   to_string(wn->book->queuePosition(wn)) + "\n";
+        }
+        return out;
+    }
+
+    string addBook(const string &line, size_t pos) {
+        int id = 0, total = 0;
+        if (!parseInt(nextWord(line, pos), id) || !parseInt(nextWord(line, pos), total)) {
+            return "ERR USAGE ADD id total title|author\n";
+        }
+        string text = rest(line, pos);
+        size_t bar = text.find('|');
+        if (bar == string::npos) return "ERR USAGE ADD id total title|author\n";
+        LibStatus st = mutate([&](Library &l) {
+            unique_lock<shared_mutex> g(catalogLock);
+            return l.addBook(id, text.substr(0, bar), text.substr(bar + 1), total);
+        });
+        if (st != LIB_OK) return string("ERR ") + statusName(st) + "\n";
+        noteMutation();
+        return "OK\n";
+    }
+
+    // One request line -> reply (status line and data lines, without the ".")
+    string handle(Session &s, const string &line) {
+        size_t pos = 0;
+        string cmd = nextWord(line, pos);
+
+        if (cmd == "LOGIN") {
+            string name = nextWord(line, pos);
+            string pass = nextWord(line, pos);
+            lock_guard<mutex> g(authLock);
+            s.loggedIn = auth.verify(name, pass, s.user);
+            return s.loggedIn ? "OK " + roleToString(s.user.role) + "\n" : "ERR LOGIN\n";
+        }
+        if (!s.loggedIn) return "ERR LOGIN REQUIRED\n";
+        bool staff = s.user.role != ROLE_STUDENT;
+
+        if (cmd == "FIND") {
+            int id = 0;
+            if (!parseInt(nextWord(line, pos), id)) return "ERR USAGE FIND id\n";
+            shared_lock<shared_mutex> cat(catalogLock);
+            BookNode *b = lib.findById(id);
+            if (b == NULL) return "ERR NOT_FOUND\n";
+            string out;
+            appendBooks(out, vector<BookNode*>(1, b));
+            return out;
+        }
+        if (cmd == "TITLE" || cmd == "AUTHOR") {
+            string q = rest(line, pos);
+            shared_lock<shared_mutex> cat(catalogLock);
+            string out;
+            appendBooks(out, cmd == "TITLE" ? lib.findByTitle(q) : lib.findByAuthor(q));
+            return out;
+        }
+        if (cmd == "COMPLETE") {
+            string field = nextWord(line, pos);
+            if (field != "TITLE" && field != "AUTHOR") {
+                return "ERR USAGE COMPLETE TITLE|AUTHOR prefix\n";
+            }
+            string prefix = rest(line, pos);
+            shared_lock<shared_mutex> cat(catalogLock);
+            vector<Completion> hits = field == "TITLE" ? lib.completeTitle(prefix, 10)
+                                                       : lib.completeAuthor(prefix, 10);
+            char num[48];
+            string out(num, snprintf(num, sizeof(num), "OK %zu\n", hits.size()));
+            for (size_t i = 0; i < hits.size(); ++i) {
+                out.append(num, snprintf(num, sizeof(num), "%d|%d|", hits[i].book->id, hits[i].books));
+                out += field == "TITLE" ? hits[i].book->title : hits[i].book->author;
+                out += '\n';
+            }
+            return out;
+        }
+        if (cmd == "RANGE") {
+            int lo, hi;
+            if (!parseInt(nextWord(line, pos), lo) || !parseInt(nextWord(line, pos), hi)) {
+                return "ERR USAGE RANGE fromId toId\n";
+            }
+            shared_lock<shared_mutex> cat(catalogLock);
+            string out;
+            appendBooks(out, lib.booksInRange(lo, hi));
+            return out;
+        }
+        if (cmd == "LIST") {
+            int fromId = numeric_limits<int>::min(), count = numeric_limits<int>::max();
+            string w = nextWord(line, pos);
+            if (!w.empty() && (!parseInt(w, fromId) || !parseInt(nextWord(line, pos), count) ||
+                               count <= 0)) {
+                return "ERR USAGE LIST [fromId count]\n";
+            }
+            shared_lock<shared_mutex> cat(catalogLock);
+            vector<BookNode*> page;
+            BookNode *next = lib.catalogPage(fromId, count, page);
+            string out;
+            appendBooks(out, page);
+            if (next != NULL) {
+                char num[24];
+                out.append(num, snprintf(num, sizeof(num), "NEXT %d\n", next->id));
+            }
+            return out;
+        }
+        if (cmd == "ISSUE" || cmd == "RETURN") {
+            if (s.user.role == ROLE_ADMIN) return "ERR FORBIDDEN\n";
+            return issueOrReturn(s, cmd, line, pos);
+        }
+        if (cmd == "STUDENT") {
+            return studentStatus(s, nextWord(line, pos));
+        }
+        if (cmd == "ADD") {
+            if (!staff) return "ERR FORBIDDEN\n";
+            return addBook(line, pos);
+        }
+        if (cmd == "DELETE") {
+            int id = 0;
+            if (s.user.role != ROLE_ADMIN) return "ERR FORBIDDEN\n";
+            if (!parseInt(nextWord(line, pos), id)) return "ERR USAGE DELETE id\n";
+            LibStatus st = mutate([&](Library &l) {
+                unique_lock<shared_mutex> g(catalogLock);
+                return l.deleteBook(id);
+            });
+            if (st != LIB_OK) return string("ERR ") + statusName(st) + "\n";
+            noteMutation();
+            return "OK\n";
+        }
+        if (cmd == "SAVE") {
+            if (!staff) return "ERR FORBIDDEN\n";
+            return save() ? "OK\n" : "ERR SAVE\n";
+        }
+        if (cmd == "METRICS") {
+            if (!staff) return "ERR FORBIDDEN\n";
+            string text = metricsText();
+            char head[32];
+            snprintf(head, sizeof(head), "OK %d\n", (int)count(text.begin(), text.end(), '\n'));
+            return head + text;
+        }
+        if (cmd == "SHUTDOWN") {
+            if (s.user.role != ROLE_ADMIN) return "ERR FORBIDDEN\n";
+            stop();
+            return "OK\n";
+        }
+        return "ERR UNKNOWN COMMAND\n";
+    }
+
+    static bool sendAll(int fd, const string &data) {
+        const char *p = data.data();
+        size_t left = data.size();
+        while (left > 0) {
+            ssize_t n = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            p += n;
+            left -= (size_t)n;
+        }
+        return true;
+    }
+
+    void runSession(int fd) {
+        Session s;
+        string pending;
+        char buf[4096];
+        bool open = true;
+        while (open) {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) break;
+            pending.append(buf, (size_t)n);
+            size_t start = 0, eol;
+            while (open && (eol = pending.find('\n', start)) != string::npos) {
+                string line = pending.substr(start, eol - start);
+                start = eol + 1;
+                if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+                if (line == "QUIT") {
+                    sendAll(fd, "OK\n.\n");
+                    open = false;
+                    break;
+                }
+                string reply = handle(s, line);
+                reply += ".\n";
+                if (!sendAll(fd, reply)) open = false;
+            }
+            pending.erase(0, start);
+        }
+        // erase and close together: once closed, accept() may hand the
+        // number to a new session, whose entry must not be the one erased
+        lock_guard<mutex> g(sessionLock);
+        sessionFds.erase(fd);
+        ::close(fd);
+        sessionsDone.notify_all();
+    }
+
+public:
+    // pipelineMode: mutations go through a CommandPipeline (see above)
+    LibraryServer(Library &library, AuthSystem &users, const string &path,
+                  bool pipelineMode = false)
+            : lib(library), auth(users), socketPath(path), listenFd(-1),
+              stopping(false), mutations(0), pipelined(pipelineMode), pipeline(NULL) {}
+
+    ~LibraryServer() {
+        delete pipeline;
+        if (listenFd >= 0) ::close(listenFd);
+    }
+
+    // Binds and listens; false (with nothing left open) if that fails.
+    bool start() {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path)) return false;
+        strcpy(addr.sun_path, socketPath.c_str());
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) return false;
+        ::unlink(socketPath.c_str());
+        if (::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            ::listen(listenFd, 128) != 0) {
+            ::close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        lib.prepareSearch();
+        lib.setConcurrent(true);
+        if (pipelined) pipeline = new CommandPipeline(lib);
+        return true;
+    }
+
+    // Accepts sessions until stop(); then ends open sessions, waits for
+    // their threads and saves.
+    void serve() {
+        while (!stopping) {
+            int fd = ::accept(listenFd, NULL, NULL);
+            if (fd < 0) {
+                if (stopping) break;
+                continue;
+            }
+            {
+                lock_guard<mutex> g(sessionLock);
+                sessionFds.insert(fd);
+            }
+            thread(&LibraryServer::runSession, this, fd).detach();
+        }
+
+        unique_lock<mutex> g(sessionLock);
+        for (set<int>::iterator it = sessionFds.begin(); it != sessionFds.end(); ++it) {
+            ::shutdown(*it, SHUT_RDWR);
+        }
+        while (!sessionFds.empty()) sessionsDone.wait(g);
+        g.unlock();
+
+        // every session has had its replies, so nothing is left queued
+        CommandPipeline *writer = NULL;
+        {
+            unique_lock<shared_mutex> cat(catalogLock);
+            swap(writer, pipeline);
+        }
+        delete writer;
+
+        unique_lock<shared_mutex> cat(catalogLock);     // a metrics dump may still run
+        lib.setConcurrent(false);
+        lib.saveToFile();
+        ::unlink(socketPath.c_str());
+    }
+
+    // Operation metrics and library gauges, Prometheus text format
+    string metricsText() {
+        string out;
+        Metrics::global().appendPrometheus(out);
+        shared_lock<shared_mutex> cat(catalogLock);
+        lib.appendMetrics(out);
+        if (pipeline != NULL) {
+            Metrics::appendGauge(out, "lms_pipeline_commands", "Mutations applied by the pipeline.",
+                                 (double)pipeline->commandsApplied());
+            Metrics::appendGauge(out, "lms_pipeline_batches", "Pipeline batches, one journal commit each.",
+                                 (double)pipeline->batchCount());
+        }
+        return out;
+    }
+
+    // Safe to call from a signal handler
+    void stop() {
+        stopping = true;
+        if (listenFd >= 0) ::shutdown(listenFd, SHUT_RDWR);
+    }
+};
+
+#endif // SERVER_H
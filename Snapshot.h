@@ -0,0 +1,352 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Book.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+// ========================= BINARY SNAPSHOT =========================
+// Versioned binary image of the whole library, including loans and waiting
+// queues. Layout (native byte order, all offsets from the start of file):
+//
+//   SnapHeader
+//   SnapBook[bookCount]     fixed-size, in id order
+//   SnapLoan[loanCount]     grouped by book, oldest loan first
+//   SnapWait[waitCount]     grouped by book, front of the queue first
+//   string heap             titles, authors and student ids (not terminated)
+//
+// Strings are (offset, length) pairs into the heap, so a mapped snapshot
+// can be read in place without parsing or copying. Library::loadFromFile
+// does not serve from the mapping, though: it copies every record into
+// nodes once, at startup (see Library::loadSnapshot).
+//
+// Version 2 adds journalGeneration: journals of an older generation are
+// already folded into the snapshot (see Library::loadFromFile). Version 1
+// files still load, as generation 0.
+
+const char SNAP_MAGIC[8] = {'L', 'M', 'S', 'S', 'N', 'A', 'P', 0};
+const uint32_t SNAP_VERSION = 2;
+const uint32_t SNAP_BYTE_ORDER = 0x01020304;
+
+struct SnapString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t bookCount;
+    uint64_t loanCount;
+    uint64_t waitCount;
+    uint64_t booksOffset;
+    uint64_t loansOffset;
+    uint64_t waitsOffset;
+    uint64_t heapOffset;
+    uint64_t heapSize;
+    uint64_t journalGeneration;     // version 2 on
+};
+
+struct SnapBook {
+    int32_t id;
+    int32_t totalCopies;
+    int32_t availableCopies;
+    uint32_t firstLoan;
+    uint32_t loanCount;
+    uint32_t firstWait;
+    uint32_t waitCount;
+    SnapString title;
+    SnapString author;
+};
+
+struct SnapLoan {
+    int32_t bookId;
+    int32_t issueDate;      // yyyymmdd
+    int32_t dueDate;        // yyyymmdd
+    SnapString studentId;
+};
+
+struct SnapWait {
+    int32_t bookId;
+    SnapString studentId;
+};
+
+// ---------- READER (mmap) ----------
+class SnapshotView {
+    const char *base;
+    size_t length;
+    const SnapHeader *hdr;
+
+    SnapshotView(const SnapshotView&);
+    SnapshotView& operator=(const SnapshotView&);
+
+    static bool fits(uint64_t offset, uint64_t bytes, size_t size) {
+        return offset <= size && bytes <= size - offset;
+    }
+
+    // count records of recordSize each from offset, with count bounded
+    // before it is multiplied, so a corrupt count cannot wrap
+    static bool fitsArray(uint64_t offset, uint64_t count, size_t recordSize, size_t size) {
+        return count <= size / recordSize && fits(offset, count * recordSize, size);
+    }
+
+    bool validate() const {
+        if (length < offsetof(SnapHeader, journalGeneration)) return false;
+        if (memcmp(hdr->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0) return false;
+        if (hdr->version < 1 || hdr->version > SNAP_VERSION) return false;
+        if (hdr->version >= 2 && length < sizeof(SnapHeader)) return false;
+        if (hdr->byteOrder != SNAP_BYTE_ORDER) return false;
+        return fitsArray(hdr->booksOffset, hdr->bookCount, sizeof(SnapBook), length) &&
+               fitsArray(hdr->loansOffset, hdr->loanCount, sizeof(SnapLoan), length) &&
+               fitsArray(hdr->waitsOffset, hdr->waitCount, sizeof(SnapWait), length) &&
+               fits(hdr->heapOffset, hdr->heapSize, length);
+    }
+
+public:
+    SnapshotView() : base(NULL), length(0), hdr(NULL) {}
+
+    ~SnapshotView() {
+        close();
+    }
+
+    // Maps the file read-only; false if it is missing or not a valid snapshot.
+    bool open(const string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED) return false;
+        base = static_cast<const char*>(m);
+        length = (size_t)st.st_size;
+        hdr = reinterpret_cast<const SnapHeader*>(base);
+        if (!validate()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (base != NULL) munmap(const_cast<char*>(base), length);
+        base = NULL;
+        length = 0;
+        hdr = NULL;
+    }
+
+    size_t bookCount() const { return (size_t)hdr->bookCount; }
+    size_t loanCount() const { return (size_t)hdr->loanCount; }
+    size_t waitCount() const { return (size_t)hdr->waitCount; }
+    uint64_t journalGeneration() const { return hdr->version >= 2 ? hdr->journalGeneration : 0; }
+
+    const SnapBook& book(size_t i) const {
+        return reinterpret_cast<const SnapBook*>(base + hdr->booksOffset)[i];
+    }
+
+    const SnapLoan& loan(size_t i) const {
+        return reinterpret_cast<const SnapLoan*>(base + hdr->loansOffset)[i];
+    }
+
+    const SnapWait& wait(size_t i) const {
+        return reinterpret_cast<const SnapWait*>(base + hdr->waitsOffset)[i];
+    }
+
+    // Empty if the reference points outside the heap
+    string_view str(const SnapString &s) const {
+        if (!fits(s.offset, s.length, (size_t)hdr->heapSize)) return string_view();
+        return string_view(base + hdr->heapOffset + s.offset, s.length);
+    }
+};
+
+// ---------- WRITER ----------
+// Books are added in id order; each book's loans and waiting students are
+// added right after it.
+class SnapshotBuilder {
+    vector<SnapBook> books;
+    vector<SnapLoan> loans;
+    vector<SnapWait> waits;
+    string heap;
+
+    SnapString intern(string_view s) {
+        SnapString r;
+        r.offset = (uint32_t)heap.size();
+        r.length = (uint32_t)s.size();
+        heap += s;
+        return r;
+    }
+
+    static bool writeAll(FILE *f, const void *p, size_t n) {
+        return n == 0 || fwrite(p, 1, n, f) == n;
+    }
+
+public:
+    void reserve(size_t bookCount) {
+        books.reserve(bookCount);
+    }
+
+    void addBook(int id, string_view title, string_view author,
+                 int total, int avail) {
+        SnapBook b;
+        memset(&b, 0, sizeof(b));
+        b.id = id;
+        b.totalCopies = total;
+        b.availableCopies = avail;
+        b.firstLoan = (uint32_t)loans.size();
+        b.firstWait = (uint32_t)waits.size();
+        b.title = intern(title);
+        b.author = intern(author);
+        books.push_back(b);
+    }
+
+    void addLoan(const string &studentId, int issueKey, int dueKey) {
+        SnapLoan l;
+        memset(&l, 0, sizeof(l));
+        l.bookId = books.back().id;
+        l.issueDate = issueKey;
+        l.dueDate = dueKey;
+        l.studentId = intern(studentId);
+        loans.push_back(l);
+        books.back().loanCount++;
+    }
+
+    void addWait(const string &studentId) {
+        SnapWait w;
+        memset(&w, 0, sizeof(w));
+        w.bookId = books.back().id;
+        w.studentId = intern(studentId);
+        waits.push_back(w);
+        books.back().waitCount++;
+    }
+
+    // Writes and fsyncs the snapshot; false on any I/O error, and (nothing
+    // written) if string offsets or loan / queue indexes would not fit in
+    // their 32-bit fields.
+    bool writeTo(const string &path, uint64_t journalGeneration = 0) const {
+        if (heap.size() > UINT32_MAX || loans.size() > UINT32_MAX ||
+            waits.size() > UINT32_MAX) {
+            return false;
+        }
+        SnapHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+        h.version = SNAP_VERSION;
+        h.byteOrder = SNAP_BYTE_ORDER;
+        h.bookCount = books.size();
+        h.loanCount = loans.size();
+        h.waitCount = waits.size();
+        h.booksOffset = sizeof(SnapHeader);
+        h.loansOffset = h.booksOffset + books.size() * sizeof(SnapBook);
+        h.waitsOffset = h.loansOffset + loans.size() * sizeof(SnapLoan);
+        h.heapOffset = h.waitsOffset + waits.size() * sizeof(SnapWait);
+        h.heapSize = heap.size();
+        h.journalGeneration = journalGeneration;
+
+        FILE *f = fopen(path.c_str(), "wb");
+        if (f == NULL) return false;
+        bool ok = writeAll(f, &h, sizeof(h)) &&
+                  writeAll(f, books.data(), books.size() * sizeof(SnapBook)) &&
+                  writeAll(f, loans.data(), loans.size() * sizeof(SnapLoan)) &&
+                  writeAll(f, waits.data(), waits.size() * sizeof(SnapWait)) &&
+                  writeAll(f, heap.data(), heap.size());
+        ok = (fflush(f) == 0) && ok;
+        if (ok) ok = fsync(fileno(f)) == 0;
+        ok = (fclose(f) == 0) && ok;
+        return ok;
+    }
+};
+
+// ---------- CONVERTERS ----------
+// books.txt -> snapshot. Same rules as the loader: records are put in id
+// order and only the first of several lines with the same id is kept.
+struct TextBook {
+    int id;
+    int total;
+    int avail;
+    string_view title;      // into the file buffer
+    string_view author;
+};
+
+inline bool textBookLess(const TextBook &a, const TextBook &b) {
+    return a.id < b.id;
+}
+
+inline bool convertTextToSnapshot(const string &textPath, const string &snapPath) {
+    FILE *f = fopen(textPath.c_str(), "rb");
+    if (f == NULL) return false;
+    string data;
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    fclose(f);
+
+    vector<TextBook> rows;
+    const char *p = data.data();
+    const char *end = p + data.size();
+    TextBook tb;
+    while (p < end) {
+        const char *eol = (const char*)memchr(p, '\n', end - p);
+        if (eol == NULL) eol = end;
+        if (eol != p && BookNode::parseFileLine(p, eol, tb.id, tb.title, tb.author,
+                                                tb.total, tb.avail)) {
+            rows.push_back(tb);
+        }
+        p = eol + 1;
+    }
+    stable_sort(rows.begin(), rows.end(), textBookLess);
+
+    SnapshotBuilder sb;
+    sb.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i > 0 && rows[i].id == rows[i-1].id) continue;
+        sb.addBook(rows[i].id, rows[i].title, rows[i].author,
+                   rows[i].total, rows[i].avail);
+    }
+    return sb.writeTo(snapPath);
+}
+
+// snapshot -> books.txt, straight from the mapping. Loans and queues have no
+// place in the text format and are dropped.
+inline bool convertSnapshotToText(const string &snapPath, const string &textPath) {
+    SnapshotView snap;
+    if (!snap.open(snapPath)) return false;
+    FILE *f = fopen(textPath.c_str(), "wb");
+    if (f == NULL) return false;
+    string line;
+    char num[48];
+    bool ok = true;
+    for (size_t i = 0; i < snap.bookCount() && ok; ++i) {
+        const SnapBook &b = snap.book(i);
+        string_view title = snap.str(b.title);
+        string_view author = snap.str(b.author);
+        snprintf(num, sizeof(num), "%d|", (int)b.id);
+        line = num;
+        line.append(title.data(), title.size());
+        line += '|';
+        line.append(author.data(), author.size());
+        snprintf(num, sizeof(num), "|%d|%d\n", (int)b.totalCopies, (int)b.availableCopies);
+        line += num;
+        ok = fwrite(line.data(), 1, line.size(), f) == line.size();
+    }
+    ok = (fflush(f) == 0) && ok;
+    return (fclose(f) == 0) && ok;
+}
+
+#endif // SNAPSHOT_H
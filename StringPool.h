@@ -0,0 +1,162 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+using namespace std;
+
+// ========================= STRING POOL =========================
+// Append-only, deduplicated storage for titles and authors. Each distinct
+// string is stored once, as a 4-byte length followed by its bytes, in
+// 64 KB chunks that never move (long text gets a block of its own). A book
+// holds a StrRef (one pointer) per field instead of a std::string (32
+// bytes, plus a heap block when the text is longer than 15 bytes). Strings
+// stay until the pool is destroyed, even once no book uses them.
+
+class StrRef {
+    const char *p;          // first byte; the uint32 length is just before it
+
+    static const char* emptyBytes() {
+        static const char bytes[5] = {0, 0, 0, 0, 0};
+        return bytes + 4;
+    }
+
+public:
+    StrRef() : p(emptyBytes()) {}
+    explicit StrRef(const char *bytes) : p(bytes) {}
+
+    const char* data() const { return p; }
+    size_t size() const {
+        uint32_t n;
+        memcpy(&n, p - 4, sizeof(n));
+        return n;
+    }
+    bool empty() const { return size() == 0; }
+
+    string_view view() const { return string_view(p, size()); }
+    string str() const { return string(p, size()); }
+    operator string_view() const { return view(); }
+
+    // By content, so refs from different pools compare too
+    bool operator==(const StrRef &o) const { return p == o.p || view() == o.view(); }
+    bool operator!=(const StrRef &o) const { return !(*this == o); }
+};
+
+inline ostream& operator<<(ostream &os, const StrRef &s) {
+    return os.write(s.data(), (streamsize)s.size());
+}
+
+class StringPool {
+    enum { CHUNK = 1 << 16 };
+
+    struct Slot {
+        const char *bytes;  // NULL = empty
+        uint32_t hash;
+    };
+
+    vector<char*> blocks;   // chunks and long-text blocks, for freeing
+    char *current;          // chunk being filled
+    size_t used;            // bytes used in current
+    size_t blockBytes;      // bytes held by all blocks
+    vector<Slot> table;     // open addressing, linear probing
+    size_t mask;
+    size_t count;           // distinct strings
+    size_t textBytes;       // their lengths added up
+
+    StringPool(const StringPool&);
+    StringPool& operator=(const StringPool&);
+
+    // FNV-1a
+    static uint32_t hashOf(string_view s) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < s.size(); ++i) {
+            h ^= (unsigned char)s[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    void rehash(size_t slots) {
+        vector<Slot> old;
+        old.swap(table);
+        Slot empty = {NULL, 0};
+        table.assign(slots, empty);
+        mask = slots - 1;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (old[i].bytes == NULL) continue;
+            size_t j = old[i].hash & mask;
+            while (table[j].bytes != NULL) j = (j + 1) & mask;
+            table[j] = old[i];
+        }
+    }
+
+    // Copies s (length first) into a chunk; returns its first byte
+    const char* store(string_view s) {
+        size_t need = 4 + s.size();
+        char *dst;
+        if (need > CHUNK / 4) {
+            // long text gets a block of its own, so chunks waste little
+            dst = (char*)malloc(need);
+            blocks.push_back(dst);
+            blockBytes += need;
+        } else {
+            if (current == NULL || used + need > CHUNK) {
+                current = (char*)malloc(CHUNK);
+                blocks.push_back(current);
+                blockBytes += CHUNK;
+                used = 0;
+            }
+            dst = current + used;
+            used += need;
+        }
+        uint32_t n = (uint32_t)s.size();
+        memcpy(dst, &n, 4);
+        memcpy(dst + 4, s.data(), s.size());
+        return dst + 4;
+    }
+
+public:
+    StringPool() : current(NULL), used(0), blockBytes(0), mask(0), count(0), textBytes(0) {
+        rehash(1024);
+    }
+
+    ~StringPool() {
+        for (size_t i = 0; i < blocks.size(); ++i) free(blocks[i]);
+    }
+
+    // The pooled copy of s, stored on first sight
+    StrRef intern(string_view s) {
+        if (s.empty()) return StrRef();
+        uint32_t h = hashOf(s);
+        size_t i = h & mask;
+        while (table[i].bytes != NULL) {
+            if (table[i].hash == h) {
+                StrRef r(table[i].bytes);
+                if (r.view() == s) return r;
+            }
+            i = (i + 1) & mask;
+        }
+        table[i].bytes = store(s);
+        table[i].hash = h;
+        ++count;
+        textBytes += s.size();
+        StrRef r(table[i].bytes);
+        if (count * 10 > table.size() * 7) rehash(table.size() * 2);
+        return r;
+    }
+
+    size_t size() const { return count; }
+    size_t storedTextBytes() const { return textBytes; }
+
+    // Text blocks plus the lookup table
+    size_t memoryBytes() const {
+        return blockBytes + table.capacity() * sizeof(Slot) + blocks.capacity() * sizeof(char*);
+    }
+};
+
+#endif // STRING_POOL_H
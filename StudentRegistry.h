@@ -0,0 +1,73 @@
+#ifndef STUDENT_REGISTRY_H
+#define STUDENT_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+using namespace std;
+
+// ========================= STUDENT REGISTRY =========================
+// Gives every student username a dense 32-bit id (0, 1, 2, ... in order of
+// first sight). Queue and loan records store the id, so checking who holds
+// or waits for a book is an integer compare; the name is looked up again
+// only for printing, the journal and snapshots.
+//
+// AuthSystem registers every student it loads or creates; names typed at
+// the librarian desk or read from the journal are added on first use.
+// Ids are never reused. Safe to share between threads.
+
+typedef uint32_t StudentId;
+
+class StudentRegistry {
+    enum { CHUNK = 4096 };              // names per block; blocks never move
+
+    unordered_map<string, StudentId> ids;
+    vector<string*> blocks;
+    StudentId count;
+    mutable mutex lock;
+
+    StudentRegistry(const StudentRegistry&);
+    StudentRegistry& operator=(const StudentRegistry&);
+
+public:
+    StudentRegistry() : count(0) {}
+
+    ~StudentRegistry() {
+        for (size_t i = 0; i < blocks.size(); ++i) delete[] blocks[i];
+    }
+
+    // The name's id, added if new
+    StudentId idOf(const string &name) {
+        lock_guard<mutex> g(lock);
+        unordered_map<string, StudentId>::const_iterator it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        if (count % CHUNK == 0) blocks.push_back(new string[CHUNK]);
+        blocks[count / CHUNK][count % CHUNK] = name;
+        ids.insert(make_pair(name, count));
+        return count++;
+    }
+
+    // False (out untouched) if the name was never registered
+    bool find(const string &name, StudentId &out) const {
+        lock_guard<mutex> g(lock);
+        unordered_map<string, StudentId>::const_iterator it = ids.find(name);
+        if (it == ids.end()) return false;
+        out = it->second;
+        return true;
+    }
+
+    // id must have come from idOf
+    const string& nameOf(StudentId id) const {
+        lock_guard<mutex> g(lock);
+        return blocks[id / CHUNK][id % CHUNK];
+    }
+
+    size_t size() const {
+        lock_guard<mutex> g(lock);
+        return count;
+    }
+};
+
+#endif // STUDENT_REGISTRY_H
@@ -6,6 +6,10 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "Metrics.h"
+#include "StudentRegistry.h"
 using namespace std;
 
 enum Role {
@@ -35,11 +39,95 @@ inline Role stringToRole(const string &s) {
     return ROLE_STUDENT;
 }
 
+// Identity of the users file as last read: if any of these change, the
+// file was edited or replaced and the directory is reloaded.
+struct FileStamp {
+    bool exists;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    time_t mtimeSec;
+    long mtimeNsec;
+};
+
+inline FileStamp stampOf(const string &path) {
+    FileStamp fs = {false, 0, 0, 0, 0, 0};
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return fs;
+    fs.exists = true;
+    fs.device = st.st_dev;
+    fs.inode = st.st_ino;
+    fs.size = st.st_size;
+    fs.mtimeSec = st.st_mtime;
+#ifdef __APPLE__
+    fs.mtimeNsec = st.st_mtimespec.tv_nsec;
+#else
+    fs.mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+    return fs;
+}
+
+inline bool sameStamp(const FileStamp &a, const FileStamp &b) {
+    return a.exists == b.exists && a.device == b.device && a.inode == b.inode &&
+           a.size == b.size && a.mtimeSec == b.mtimeSec && a.mtimeNsec == b.mtimeNsec;
+}
+
 class AuthSystem {
     string filename;
+    // In-memory user directory, keyed by username
+    unordered_map<string, User> directory;
+    FileStamp loadedStamp;
+    StudentRegistry *registry;      // given every student username; may be NULL
+
+    void registerIds() {
+        if (registry == NULL) return;
+        for (unordered_map<string, User>::const_iterator it = directory.begin();
+             it != directory.end(); ++it) {
+            if (it->second.role == ROLE_STUDENT) registry->idOf(it->first);
+        }
+    }
+
+    // Re-reads users.txt only if it changed since the last load (one stat
+    // call otherwise). Returns false if the file cannot be read.
+    bool refresh() {
+        FileStamp now = stampOf(filename);
+        if (!now.exists) {
+            directory.clear();
+            loadedStamp = now;
+            return false;
+        }
+        if (sameStamp(now, loadedStamp)) return true;
+
+        vector<User> users;
+        if (!loadAllUsers(users)) return false;
+        directory.clear();
+        directory.reserve(users.size());
+        for (size_t i = 0; i < users.size(); ++i) {
+            directory.insert(make_pair(users[i].username, users[i]));
+        }
+        loadedStamp = now;
+        registerIds();
+        return true;
+    }
+
 public:
     explicit AuthSystem(const string &file = "users.txt")
-            : filename(file) {}
+            : filename(file), registry(NULL) {
+        FileStamp none = {false, 0, 0, 0, 0, 0};
+        loadedStamp = none;
+    }
+
+    // Student usernames get their ids here from now on (and right away)
+    void attachRegistry(StudentRegistry *r) {
+        registry = r;
+        refresh();
+        registerIds();
+    }
+
+    size_t userCount() {
+        refresh();
+        return directory.size();
+    }
 
     // Create default users file if it does not exist
     void ensureDefaultUsers() {
@@ -80,9 +168,25 @@ public:
         return true;
     }
 
+    // Looks the pair up in the directory; O(1) regardless of user count.
+    bool authenticate(const string &uname, const string &pass, User &outUser) {
+        LMS_TIME(OP_LOGIN);
+        unordered_map<string, User>::const_iterator it = directory.find(uname);
+        if (it == directory.end() || it->second.password != pass) {
+            LMS_FAIL(OP_LOGIN);
+            return false;
+        }
+        outUser = it->second;
+        return true;
+    }
+
+    // login without the console: picks up users.txt changes, then looks up
+    bool verify(const string &uname, const string &pass, User &outUser) {
+        return refresh() && authenticate(uname, pass, outUser);
+    }
+
     bool login(User &outUser) {
-        vector<User> users;
-        if (!loadAllUsers(users)) {
+        if (!refresh()) {
             cout << "Cannot open users file.\n";
             return false;
         }
@@ -92,14 +196,10 @@ public:
         cout << "Password: ";
         cin >> pass;
 
-        for (size_t i = 0; i < users.size(); ++i) {
-            const User &u = users[i];
-            if (u.username == uname && u.password == pass) {
-                outUser = u;
-                cout << "Logged in as " << uname
-                     << " (" << roleToString(u.role) << ")\n";
-                return true;
-            }
+        if (authenticate(uname, pass, outUser)) {
+            cout << "Logged in as " << uname
+                 << " (" << roleToString(outUser.role) << ")\n";
+            return true;
         }
         cout << "Invalid username or password.\n";
         return false;
@@ -107,25 +207,33 @@ public:
 
     // Admin can register a new student user
     void registerStudent() {
-        vector<User> users;
-        loadAllUsers(users);
+        refresh();
 
         string uname, pass;
         cout << "Enter new student username (used as Student ID): ";
         cin >> uname;
 
-        for (size_t i = 0; i < users.size(); ++i) {
-            if (users[i].username == uname) {
-                cout << "User already exists.\n";
-                return;
-            }
+        if (directory.count(uname) > 0) {
+            cout << "User already exists.\n";
+            return;
         }
         cout << "Enter password: ";
         cin >> pass;
 
+        // Append to the file and the directory; if nobody else touched the
+        // file meanwhile, take its new stamp so it is not re-read next time.
+        bool wasCurrent = sameStamp(stampOf(filename), loadedStamp);
         ofstream fout(filename.c_str(), ios::app);
         fout << uname << "|" << pass << "|STUDENT\n";
         fout.close();
+
+        User u;
+        u.username = uname;
+        u.password = pass;
+        u.role = ROLE_STUDENT;
+        directory.insert(make_pair(uname, u));
+        if (registry != NULL) registry->idOf(uname);
+        if (wasCurrent) loadedStamp = stampOf(filename);
         cout << "Student registered successfully.\n";
     }
 };